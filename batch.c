@@ -0,0 +1,505 @@
+#include "defs.h"
+
+// the statistics of a running batch, every worker merges its own into them every BATCH_FLUSH_RUNS hunts
+typedef struct BatchTotal
+{
+  BatchStats stats;
+  pthread_mutex_t mutex;
+  FILE *rows; // where a row is written every time another every hunts are merged, NULL writes none
+  long every;
+  long nextRow;
+  long lastRow; // hunts in the last row written
+} BatchTotal;
+
+typedef struct BatchWorker
+{
+  atomic_long *next;
+  long runs;
+  uint64_t seed;
+  SimOptions *opts;
+  BatchStats stats; // hunts not yet merged into total
+  BatchTotal *total;
+} BatchWorker;
+
+/// @brief decides how a finished hunt ended
+/// @param b the building whose hunters are checked
+/// @return GHOST_WIN if every hunter ran away scared, HUNTERS_WIN if any hunter found enough different ghostly evidence, otherwise ALL_BORED
+OutcomeType evaluateOutcome(BuildingType *b)
+{
+  bool areScared = true;
+  bool foundGhost = false;
+  for (int i = 0; i < b->noteBook->count; i++)
+  {
+    if (b->table.fear[i] < b->config.maxFear)
+    {
+      areScared = false;
+    }
+    if (knownKinds(b, i) >= b->config.foundKinds)
+    {
+      foundGhost = true;
+    }
+  }
+  if (areScared)
+  {
+    return GHOST_WIN;
+  }
+  if (foundGhost)
+  {
+    return HUNTERS_WIN;
+  }
+  return ALL_BORED;
+}
+
+/// @brief initalizes a result for runSimulation, one result can be reused for every hunt a thread runs
+/// @param r the result being initalized
+void initSimResult(SimResult *r)
+{
+  memset(r, 0, sizeof(SimResult));
+  r->fear = NULL;
+}
+
+/// @brief frees the fears kept by a result
+/// @param r the result being cleaned up
+void cleanupSimResult(SimResult *r)
+{
+  free(r->fear);
+}
+
+/// @brief runs one full hunt on the calling thread through the discrete event scheduler
+/// @param seed seed for the hunt, the same seed always plays out the same hunt
+/// @param opts how the hunt is set up
+/// @param result where the outcome of the hunt is stored, initalized with initSimResult
+void runSimulation(uint64_t seed, SimOptions *opts, SimResult *result)
+{
+  BuildingType *b = NULL;
+  initBuilding(&b, seed);
+  if (opts->config != NULL)
+  {
+    b->config = *opts->config;
+  }
+  if (opts->layout != NULL)
+  {
+    buildFromLayout(b, opts->layout);
+  }
+  else if (opts->map != NULL)
+  {
+    buildFromMap(b, opts->map);
+  }
+  else
+  {
+    populateRooms(b);
+  }
+
+  // equipment is handed out in turn, so every type is covered once there are enough hunters
+  for (int i = 0; i < opts->hunters; i++)
+  {
+    char name[MAX_STR];
+    HunterType *h = NULL;
+    snprintf(name, MAX_STR, "Hunter %d", i + 1);
+    initHunter(name, i % NUM_EVIDENCE_TYPES, b, &h);
+  }
+
+  for (int i = 0; i < opts->ghosts; i++)
+  {
+    GhostType *g = NULL;
+    initGhost(b, &g);
+  }
+
+  Scheduler *s = NULL;
+  initScheduler(&s);
+  if (!opts->ticks)
+  {
+    scheduleBuilding(s, b);
+  }
+  if (opts->traceDir != NULL)
+  {
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/%llu.trace", opts->traceDir, (unsigned long long)seed);
+    if (startTrace(b, path, &s->now) != 0)
+    {
+      fprintf(stderr, "could not record %s\n", path);
+    }
+  }
+  if (opts->ticks)
+  {
+    runTicks(s, b);
+  }
+  else
+  {
+    runScheduler(s);
+  }
+  stopTrace(b);
+
+  result->outcome = evaluateOutcome(b);
+  result->steps = s->steps;
+  result->simTime = s->now;
+  result->seed = seed;
+  memset(result->ghosts, 0, sizeof(result->ghosts));
+  memset(result->identified, 0, sizeof(result->identified));
+  memset(result->evidenceDropped, 0, sizeof(result->evidenceDropped));
+  identifyGhosts(b);
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    GhostType *g = b->ghosts[i];
+    result->ghosts[g->type]++;
+    result->identified[g->type] += g->identified;
+    result->evidenceDropped[g->type] += g->evidenceDropped;
+  }
+  result->readings = evidenceLogSize(b->evidence);
+  result->ghostlyReadings = countGhostlyLog(b->evidence);
+
+  // every hunter has left by now, each with the check it left on, since in ticks check is redone for hunters that have left
+  int hunters = b->noteBook->count;
+  if (hunters > result->fearCapacity)
+  {
+    result->fearCapacity = hunters;
+    result->fear = realloc(result->fear, hunters * sizeof(int));
+  }
+  result->fearCount = hunters;
+  memset(result->equipment, 0, sizeof(result->equipment));
+  memset(result->equipmentFound, 0, sizeof(result->equipmentFound));
+  memset(result->equipmentScared, 0, sizeof(result->equipmentScared));
+  for (int i = 0; i < hunters; i++)
+  {
+    HunterType *h = b->noteBook->hunters[i];
+    result->fear[i] = b->table.fear[h->id];
+    result->equipment[h->equipment]++;
+    result->equipmentFound[h->equipment] += b->table.exitCheck[h->id] == CHECK_FOUND;
+    result->equipmentScared[h->equipment] += b->table.exitCheck[h->id] == CHECK_SCARED;
+  }
+
+  cleanupScheduler(s);
+  cleanupBuilding(b);
+}
+
+/// @brief zeroes a set of batch statistics
+/// @param s the statistics being initalized
+/// @param sketches whether to keep quantile sketches of the run length and fear at exit, which take a fixed 2 x 11KB
+void initBatchStats(BatchStats *s, bool sketches)
+{
+  memset(s, 0, sizeof(BatchStats));
+  s->runLength = sketches ? calloc(1, sizeof(QuantileSketch)) : NULL;
+  s->fearAtExit = sketches ? calloc(1, sizeof(QuantileSketch)) : NULL;
+}
+
+/// @brief zeroes a set of batch statistics once they have been merged elsewhere, keeping its sketches if it has them
+/// @param s the statistics being cleared
+void clearBatchStats(BatchStats *s)
+{
+  QuantileSketch *runLength = s->runLength;
+  QuantileSketch *fearAtExit = s->fearAtExit;
+  memset(s, 0, sizeof(BatchStats));
+  if (runLength != NULL)
+  {
+    memset(runLength, 0, sizeof(QuantileSketch));
+    memset(fearAtExit, 0, sizeof(QuantileSketch));
+  }
+  s->runLength = runLength;
+  s->fearAtExit = fearAtExit;
+}
+
+/// @brief frees the sketches of a set of batch statistics
+/// @param s the statistics being cleaned up
+void cleanupBatchStats(BatchStats *s)
+{
+  free(s->runLength);
+  free(s->fearAtExit);
+}
+
+/// @brief adds the result of one hunt to a set of batch statistics
+/// @param r the result of the finished hunt
+/// @param s the statistics being added to
+void addSimResult(SimResult *r, BatchStats *s)
+{
+  s->runs++;
+  s->outcomes[r->outcome]++;
+  s->totalSteps += r->steps;
+  s->totalSimTime += r->simTime;
+  s->readings += r->readings;
+  s->ghostlyReadings += r->ghostlyReadings;
+  for (int i = 0; i < NUM_GHOST_TYPES; i++)
+  {
+    s->ghostRuns[i] += r->ghosts[i];
+    s->ghostIdentified[i] += r->identified[i];
+    s->ghostEvidence[i] += r->evidenceDropped[i];
+    if (r->outcome == HUNTERS_WIN)
+    {
+      s->ghostHunterWins[i] += r->ghosts[i];
+    }
+  }
+  for (int i = 0; i < NUM_EVIDENCE_TYPES; i++)
+  {
+    s->equipment[i] += r->equipment[i];
+    s->equipmentFound[i] += r->equipmentFound[i];
+    s->equipmentScared[i] += r->equipmentScared[i];
+  }
+  addRunningStat(&s->steps, r->steps);
+  addRunningStat(&s->simTime, r->simTime);
+  for (int i = 0; i < r->fearCount; i++)
+  {
+    addRunningStat(&s->fear, r->fear[i]);
+  }
+  if (s->runLength != NULL)
+  {
+    addSketch(s->runLength, r->steps);
+    for (int i = 0; i < r->fearCount; i++)
+    {
+      addSketch(s->fearAtExit, r->fear[i]);
+    }
+  }
+}
+
+/// @brief adds one set of batch statistics into another
+/// @param from the statistics being merged
+/// @param into the statistics being merged into
+void mergeBatchStats(BatchStats *from, BatchStats *into)
+{
+  into->runs += from->runs;
+  into->totalSteps += from->totalSteps;
+  into->totalSimTime += from->totalSimTime;
+  into->readings += from->readings;
+  into->ghostlyReadings += from->ghostlyReadings;
+  for (int i = 0; i < NUM_OUTCOMES; i++)
+  {
+    into->outcomes[i] += from->outcomes[i];
+  }
+  for (int i = 0; i < NUM_GHOST_TYPES; i++)
+  {
+    into->ghostRuns[i] += from->ghostRuns[i];
+    into->ghostHunterWins[i] += from->ghostHunterWins[i];
+    into->ghostIdentified[i] += from->ghostIdentified[i];
+    into->ghostEvidence[i] += from->ghostEvidence[i];
+  }
+  for (int i = 0; i < NUM_EVIDENCE_TYPES; i++)
+  {
+    into->equipment[i] += from->equipment[i];
+    into->equipmentFound[i] += from->equipmentFound[i];
+    into->equipmentScared[i] += from->equipmentScared[i];
+  }
+  mergeRunningStat(&from->steps, &into->steps);
+  mergeRunningStat(&from->simTime, &into->simTime);
+  mergeRunningStat(&from->fear, &into->fear);
+  if (from->runLength != NULL && into->runLength != NULL)
+  {
+    mergeSketch(from->runLength, into->runLength);
+    mergeSketch(from->fearAtExit, into->fearAtExit);
+  }
+}
+
+/// @brief merges the hunts a worker has run since it last did into the statistics of the batch, and writes a row if another
+///        every hunts have been merged since the last one
+/// @param w the worker
+static void flushBatchWorker(BatchWorker *w)
+{
+  BatchTotal *t = w->total;
+  pthread_mutex_lock(&t->mutex);
+  mergeBatchStats(&w->stats, &t->stats);
+  if (t->rows != NULL && t->stats.runs >= t->nextRow)
+  {
+    writeBatchRow(t->rows, &t->stats);
+    t->lastRow = t->stats.runs;
+    while (t->nextRow <= t->stats.runs)
+    {
+      t->nextRow += t->every;
+    }
+  }
+  pthread_mutex_unlock(&t->mutex);
+  clearBatchStats(&w->stats);
+}
+
+/// @brief worker thread for a batch, claims hunts from the shared counter until none are left
+/// @param arg void pointer, will be typecasted to a BatchWorker
+static void *batchWorker(void *arg)
+{
+  BatchWorker *w = (BatchWorker *)arg;
+  SimResult r;
+  initSimResult(&r);
+  long i;
+  while ((i = atomic_fetch_add(w->next, 1)) < w->runs)
+  {
+    // hunt i is seeded by its index so it does not matter which worker picks it up
+    runSimulation(w->seed + i, w->opts, &r);
+    addSimResult(&r, &w->stats);
+    if (w->stats.runs == BATCH_FLUSH_RUNS)
+    {
+      flushBatchWorker(w);
+    }
+  }
+  flushBatchWorker(w);
+  cleanupSimResult(&r);
+  return NULL;
+}
+
+/// @brief runs many independent hunts spread across worker threads, each keeping its own statistics which it merges into
+///        the batch every BATCH_FLUSH_RUNS hunts, so nothing is kept per hunt however many are run
+/// @param runs the number of hunts to run
+/// @param threads the number of worker threads, 0 uses one per online core
+/// @param seed seed of the first hunt, hunt i uses seed + i
+/// @param opts how every hunt is set up, shared read only
+/// @param rows where a CSV header and then a row of the statistics so far is written every time another every hunts are merged,
+///             and once more at the end, NULL writes none
+/// @param every hunts between rows
+/// @param stats where the merged statistics are stored, initalized with sketches, clean them up with cleanupBatchStats
+void runBatch(long runs, int threads, uint64_t seed, SimOptions *opts, FILE *rows, long every, BatchStats *stats)
+{
+  if (threads <= 0)
+  {
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+    {
+      threads = 1;
+    }
+  }
+
+  BatchTotal total;
+  initBatchStats(&total.stats, true);
+  pthread_mutex_init(&total.mutex, NULL);
+  total.rows = rows;
+  total.every = every > 0 ? every : BATCH_ROW_EVERY;
+  total.nextRow = total.every;
+  total.lastRow = 0;
+  if (rows != NULL)
+  {
+    writeBatchHeader(rows);
+  }
+
+  atomic_long next = 0;
+  pthread_t *ids = calloc(threads, sizeof(pthread_t));
+  BatchWorker *workers = calloc(threads, sizeof(BatchWorker));
+
+  for (int i = 0; i < threads; i++)
+  {
+    workers[i].next = &next;
+    workers[i].runs = runs;
+    workers[i].seed = seed;
+    workers[i].opts = opts;
+    workers[i].total = &total;
+    initBatchStats(&workers[i].stats, true);
+    pthread_create(ids + i, NULL, batchWorker, workers + i);
+  }
+
+  for (int i = 0; i < threads; i++)
+  {
+    pthread_join(ids[i], NULL);
+    cleanupBatchStats(&workers[i].stats);
+  }
+  // the last row holds the whole batch, unless it was just written
+  if (rows != NULL && total.stats.runs != total.lastRow)
+  {
+    writeBatchRow(rows, &total.stats);
+  }
+
+  pthread_mutex_destroy(&total.mutex);
+  *stats = total.stats;
+  free(workers);
+  free(ids);
+}
+
+/// @brief prints the aggregate results of a batch
+/// @param s the statistics being printed
+void printBatchStats(BatchStats *s)
+{
+  double runs = s->runs > 0 ? (double)s->runs : 1.0;
+  printf("RUNS: %ld\n", s->runs);
+  printf("HUNTER WIN RATE: %6.2f%%\n", 100.0 * s->outcomes[HUNTERS_WIN] / runs);
+  printf("GHOST WIN RATE:  %6.2f%%\n", 100.0 * s->outcomes[GHOST_WIN] / runs);
+  printf("BORED OUT RATE:  %6.2f%%\n", 100.0 * s->outcomes[ALL_BORED] / runs);
+  printf("MEAN RUN LENGTH: %.2f steps, %.2f s simulated\n", s->totalSteps / runs, s->totalSimTime / runs);
+  printf("GHOSTLY READINGS: %lld OF %lld (%.2f%%)\n", s->ghostlyReadings, s->readings, 100.0 * s->ghostlyReadings / (s->readings > 0 ? s->readings : 1));
+  printf("%-12s %10s %12s %12s %14s\n", "GHOST", "RUNS", "HUNTER WINS", "IDENTIFIED", "MEAN EVIDENCE");
+  for (int i = 0; i < NUM_GHOST_TYPES; i++)
+  {
+    double n = s->ghostRuns[i] > 0 ? (double)s->ghostRuns[i] : 1.0;
+    printf("%-12s %10ld %12ld %12ld %14.2f\n", ghostEnumToStr(i), s->ghostRuns[i], s->ghostHunterWins[i], s->ghostIdentified[i], s->ghostEvidence[i] / n);
+  }
+  printf("%-12s %10s %12s %12s\n", "EQUIPMENT", "HUNTERS", "FOUND GHOST", "SCARED");
+  for (int i = 0; i < NUM_EVIDENCE_TYPES; i++)
+  {
+    double n = s->equipment[i] > 0 ? (double)s->equipment[i] : 1.0;
+    printf("%-12s %10ld %11.2f%% %11.2f%%\n", evidenceEnumToStr(i), s->equipment[i], 100.0 * s->equipmentFound[i] / n, 100.0 * s->equipmentScared[i] / n);
+  }
+  printf("RUN LENGTH: SD %.2f steps", runningStdDev(&s->steps));
+  if (s->runLength != NULL)
+  {
+    printf(", P50 %.0f, P90 %.0f, P99 %.0f", sketchQuantile(s->runLength, 0.5), sketchQuantile(s->runLength, 0.9), sketchQuantile(s->runLength, 0.99));
+  }
+  printf("\nFEAR AT EXIT: MEAN %.2f, SD %.2f", s->fear.mean, runningStdDev(&s->fear));
+  if (s->fearAtExit != NULL)
+  {
+    printf(", P50 %.0f, P90 %.0f, P99 %.0f", sketchQuantile(s->fearAtExit, 0.5), sketchQuantile(s->fearAtExit, 0.9), sketchQuantile(s->fearAtExit, 0.99));
+  }
+  printf("\n");
+}
+
+/// @brief writes a column name made of an upper case name, lowered, and a suffix, preceded by a comma
+/// @param out the file written to
+/// @param name the name, eg. "EMF"
+/// @param suffix what is measured, eg. "_hunters"
+static void writeColumn(FILE *out, const char *name, const char *suffix)
+{
+  fputc(',', out);
+  for (const char *c = name; *c != '\0'; c++)
+  {
+    fputc(tolower((unsigned char)*c), out);
+  }
+  fputs(suffix, out);
+}
+
+/// @brief writes the CSV header of the rows writeBatchRow writes, one column per statistic
+/// @param out the file written to
+void writeBatchHeader(FILE *out)
+{
+  fprintf(out, "runs,hunter_win_rate,ghost_win_rate,bored_rate,steps_mean,steps_sd,steps_p50,steps_p90,steps_p99,sim_seconds_mean,sim_seconds_sd,"
+               "fear_mean,fear_sd,fear_p50,fear_p90,fear_p99");
+  for (int i = 0; i < NUM_GHOST_TYPES; i++)
+  {
+    writeColumn(out, ghostEnumToStr(i), "_runs");
+    writeColumn(out, ghostEnumToStr(i), "_hunter_win_rate");
+  }
+  for (int i = 0; i < NUM_EVIDENCE_TYPES; i++)
+  {
+    writeColumn(out, evidenceEnumToStr(i), "_hunters");
+    writeColumn(out, evidenceEnumToStr(i), "_found_rate");
+    writeColumn(out, evidenceEnumToStr(i), "_scared_rate");
+  }
+  fputc('\n', out);
+  fflush(out);
+}
+
+/// @brief writes the statistics of a batch so far as one CSV row, in the columns of writeBatchHeader, and flushes it
+/// @param out the file written to
+/// @param s the statistics, the quantile columns are left empty without sketches
+void writeBatchRow(FILE *out, BatchStats *s)
+{
+  double runs = s->runs > 0 ? (double)s->runs : 1.0;
+  fprintf(out, "%ld,%.4f,%.4f,%.4f", s->runs, s->outcomes[HUNTERS_WIN] / runs, s->outcomes[GHOST_WIN] / runs, s->outcomes[ALL_BORED] / runs);
+  fprintf(out, ",%.2f,%.2f", s->steps.mean, runningStdDev(&s->steps));
+  if (s->runLength != NULL)
+  {
+    fprintf(out, ",%.0f,%.0f,%.0f", sketchQuantile(s->runLength, 0.5), sketchQuantile(s->runLength, 0.9), sketchQuantile(s->runLength, 0.99));
+  }
+  else
+  {
+    fprintf(out, ",,,");
+  }
+  fprintf(out, ",%.2f,%.2f,%.2f,%.2f", s->simTime.mean, runningStdDev(&s->simTime), s->fear.mean, runningStdDev(&s->fear));
+  if (s->fearAtExit != NULL)
+  {
+    fprintf(out, ",%.0f,%.0f,%.0f", sketchQuantile(s->fearAtExit, 0.5), sketchQuantile(s->fearAtExit, 0.9), sketchQuantile(s->fearAtExit, 0.99));
+  }
+  else
+  {
+    fprintf(out, ",,,");
+  }
+  for (int i = 0; i < NUM_GHOST_TYPES; i++)
+  {
+    fprintf(out, ",%ld,%.4f", s->ghostRuns[i], s->ghostHunterWins[i] / (s->ghostRuns[i] > 0 ? (double)s->ghostRuns[i] : 1.0));
+  }
+  for (int i = 0; i < NUM_EVIDENCE_TYPES; i++)
+  {
+    double n = s->equipment[i] > 0 ? (double)s->equipment[i] : 1.0;
+    fprintf(out, ",%ld,%.4f,%.4f", s->equipment[i], s->equipmentFound[i] / n, s->equipmentScared[i] / n);
+  }
+  fprintf(out, "\n");
+  fflush(out);
+}
@@ -0,0 +1,514 @@
+#include "defs.h"
+
+/*
+    Benchmark suite, built and run by make bench.
+
+    Microbenchmarks time one hot operation in a tight loop and report
+    the best nanoseconds per operation out of BENCH_REPS repetitions, so
+    a noisy repetition does not count. Macrobenchmarks run whole hunts
+    on the calling thread, on the discrete event scheduler or in lock
+    step ticks, for about BENCH_SECONDS each, across building sizes and
+    entity counts.
+
+    Results are written as JSON, to stdout or the file given with -o:
+
+        {"version": 1, "seed": S,
+         "micro": [{"name": "...", "ops": N, "ns_per_op": X}, ...],
+         "macro": [{"mode": "events" or "ticks", "rooms": R,
+                    "hunters": H, "ghosts": G, "runs": N,
+                    "sims_per_sec": X, "steps_per_sec": Y}, ...]}
+
+    -s sets the seed and -t the seconds spent on each macrobenchmark.
+*/
+
+#define BENCH_REPS 5
+#define BENCH_SECONDS 0.5
+#define BENCH_SAMPLES 4096
+// rooms in the building the building benchmarks make over and over
+#define BENCH_BUILD_ROOMS 10000
+
+// results are added into this so the compiler can not drop the work being timed
+static volatile long sink;
+
+/// @brief seconds on the monotonic clock
+/// @return the time
+static double benchTime(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/// @brief writes one microbenchmark result as a JSON object
+/// @param out the file written to
+/// @param first whether this is the first result, the rest are preceded by a comma
+/// @param name the operation
+/// @param ops operations per repetition
+/// @param best the fastest repetition in seconds
+static void writeMicro(FILE *out, bool first, const char *name, long ops, double best)
+{
+  fprintf(out, "%s\n    {\"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.3f}", first ? "" : ",", name, ops, best * 1e9 / ops);
+  fprintf(stderr, "%-24s %10.3f ns/op\n", name, best * 1e9 / ops);
+}
+
+/// @brief builds the default house with one hunter of each equipment in the spawn room, for the microbenchmarks that need them
+/// @param b double pointer to store the building
+/// @param seed the seed of the building
+static void benchBuilding(BuildingType **b, uint64_t seed)
+{
+  initBuilding(b, seed);
+  populateRooms(*b);
+  for (int i = 0; i < NUM_EVIDENCE_TYPES; i++)
+  {
+    char name[MAX_STR];
+    HunterType *h = NULL;
+    snprintf(name, MAX_STR, "Bench %d", i + 1);
+    initHunter(name, i, *b, &h);
+  }
+}
+
+/// @brief times walking from room to random connected room
+/// @param seed seeds the walk
+/// @param ops steps per repetition
+/// @return the fastest repetition in seconds
+static double benchFindRandRoom(uint64_t seed, long ops)
+{
+  BuildingType *b = NULL;
+  benchBuilding(&b, seed);
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    RoomType *r = b->spawn;
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      RoomType *next = findRandRoom(b, r, &b->rng);
+      r = next != NULL ? next : b->spawn;
+    }
+    double t = benchTime() - start;
+    sink += r->id;
+    best = t < best ? t : best;
+  }
+  cleanupBuilding(b);
+  return best;
+}
+
+/// @brief times allocating an evidence and a node for it from a pool, the pool is freed between repetitions
+/// @param seed unused, every benchmark takes one
+/// @param ops allocations per repetition
+/// @return the fastest repetition in seconds
+static double benchAllocEvidence(uint64_t seed, long ops)
+{
+  (void)seed;
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    EvidencePool *pool = NULL;
+    initPool(&pool);
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      EvidenceType *e = NULL;
+      EvidenceNode *node = NULL;
+      initEvidence(pool, i % NUM_EVIDENCE_TYPES, (float)i, &e);
+      initEvidenceNode(pool, e, &node);
+      sink += (long)node->evidence->type;
+    }
+    double t = benchTime() - start;
+    cleanupPool(pool);
+    best = t < best ? t : best;
+  }
+  return best;
+}
+
+/// @brief times classifying evidence of every class with values around the ghostly ranges
+/// @param seed seeds the evidence values
+/// @param ops classifications per repetition
+/// @return the fastest repetition in seconds
+static double benchIsGhostly(uint64_t seed, long ops)
+{
+  RandState rng;
+  seedRand(&rng, seed);
+  EvidenceType *samples = calloc(BENCH_SAMPLES, sizeof(EvidenceType));
+  for (int i = 0; i < BENCH_SAMPLES; i++)
+  {
+    samples[i].type = randInt(&rng, 0, NUM_EVIDENCE_TYPES);
+    samples[i].value = randFloat(&rng, -15, 80);
+  }
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    long ghostly = 0;
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      ghostly += isGhostly(&samples[i & (BENCH_SAMPLES - 1)]);
+    }
+    double t = benchTime() - start;
+    sink += ghostly;
+    best = t < best ? t : best;
+  }
+  free(samples);
+  return best;
+}
+
+/// @brief times classifying readings in bulk, with more of them than fit in cache so it shows whether classifyGhostly keeps up with memory
+/// @param seed seeds the evidence values
+/// @param ops readings per repetition
+/// @return the fastest repetition in seconds
+static double benchClassifyGhostly(uint64_t seed, long ops)
+{
+  RandState rng;
+  seedRand(&rng, seed);
+  unsigned char *types = malloc(ops);
+  float *values = malloc(ops * sizeof(float));
+  uint64_t *mask = malloc((ops + 63) / 64 * sizeof(uint64_t));
+  for (long i = 0; i < ops; i++)
+  {
+    types[i] = randInt(&rng, 0, NUM_EVIDENCE_TYPES);
+    values[i] = randFloat(&rng, -15, 80);
+  }
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    double start = benchTime();
+    long ghostly = classifyGhostly(types, values, ops, mask);
+    double t = benchTime() - start;
+    sink += ghostly;
+    best = t < best ? t : best;
+  }
+  free(types);
+  free(values);
+  free(mask);
+  return best;
+}
+
+/// @brief times unlinking evidence from the front of a list, the list is filled again before every repetition
+/// @param seed unused, every benchmark takes one
+/// @param ops deletions per repetition
+/// @return the fastest repetition in seconds
+static double benchDelEvidence(uint64_t seed, long ops)
+{
+  (void)seed;
+  EvidencePool *pool = NULL;
+  initPool(&pool);
+  EvidenceType *e = NULL;
+  initEvidence(pool, EMF, 4.8, &e);
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    EvidenceList l = {NULL, NULL};
+    for (long i = 0; i < ops; i++)
+    {
+      EvidenceNode *node = NULL;
+      initEvidenceNode(pool, e, &node);
+      addEvidence(node, &l);
+    }
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      delEvidence(l.head, &l, pool);
+    }
+    double t = benchTime() - start;
+    best = t < best ? t : best;
+  }
+  cleanupPool(pool);
+  return best;
+}
+
+/// @brief times a hunter collecting ghostly evidence from its room, the room is filled again before every repetition
+/// @param seed seeds the building
+/// @param ops collections per repetition
+/// @return the fastest repetition in seconds
+static double benchCollectEvidence(uint64_t seed, long ops)
+{
+  BuildingType *b = NULL;
+  benchBuilding(&b, seed);
+  HunterType *h = b->noteBook->hunters[EMF];
+  EvidencePool *pool = NULL;
+  initPool(&pool);
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    for (long i = 0; i < ops; i++)
+    {
+      EvidenceType *e = NULL;
+      EvidenceNode *node = NULL;
+      initEvidence(pool, EMF, 4.8, &e);
+      initEvidenceNode(pool, e, &node);
+      addRoomEvidence(h->room, node);
+    }
+    long collected = 0;
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      collected += collectEvidence(h);
+    }
+    double t = benchTime() - start;
+    sink += collected;
+    best = t < best ? t : best;
+  }
+  // the room nodes were recycled into the hunters pool, so it goes before the pool they came from
+  cleanupBuilding(b);
+  cleanupPool(pool);
+  return best;
+}
+
+/// @brief times one hunter sharing the kinds of ghostly evidence it knows of with another
+/// @param seed seeds the building
+/// @param ops shares per repetition
+/// @return the fastest repetition in seconds
+static double benchShareEvidence(uint64_t seed, long ops)
+{
+  BuildingType *b = NULL;
+  benchBuilding(&b, seed);
+  HunterType *from = b->noteBook->hunters[EMF];
+  HunterType *to = b->noteBook->hunters[SOUND];
+  learnGhostly(from, EMF);
+  learnGhostly(from, TEMPERATURE);
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      shareGhostlyEvidence(from, to);
+    }
+    double t = benchTime() - start;
+    sink += knownKinds(b, to->id);
+    best = t < best ? t : best;
+  }
+  cleanupBuilding(b);
+  return best;
+}
+
+/// @brief makes a map of a given number of rooms, a corridor through every room with extra doors between far apart rooms
+/// @param rooms the number of rooms
+/// @param map double pointer to store the map
+static void benchMap(int rooms, BuildingMap **map)
+{
+  BuildingMap *m = calloc(1, sizeof(BuildingMap));
+  m->roomCount = rooms;
+  m->names = calloc(rooms, MAX_STR);
+  m->edges = malloc(2 * rooms * sizeof(int[2]));
+  for (int i = 0; i < rooms; i++)
+  {
+    snprintf(m->names[i], MAX_STR, "Room %d", i);
+  }
+  for (int i = 0; i + 1 < rooms; i++)
+  {
+    m->edges[m->edgeCount][0] = i;
+    m->edges[m->edgeCount][1] = i + 1;
+    m->edgeCount++;
+  }
+  for (int i = 0; i < rooms; i += 3)
+  {
+    int j = (int)(((long)i * 7 + 3) % rooms);
+    if (j != i)
+    {
+      m->edges[m->edgeCount][0] = i;
+      m->edges[m->edgeCount][1] = j;
+      m->edgeCount++;
+    }
+  }
+  m->spawn = 0;
+  *map = m;
+}
+
+/// @brief times making a building from a map, each building made is cleaned up before the next
+/// @param seed seeds the buildings
+/// @param ops buildings made per repetition
+/// @return the fastest repetition in seconds
+static double benchBuildFromMap(uint64_t seed, long ops)
+{
+  BuildingMap *map = NULL;
+  benchMap(BENCH_BUILD_ROOMS, &map);
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      BuildingType *b = NULL;
+      initBuilding(&b, seed);
+      buildFromMap(b, map);
+      sink += b->spawn->id;
+      cleanupBuilding(b);
+    }
+    double t = benchTime() - start;
+    best = t < best ? t : best;
+  }
+  cleanupMap(map);
+  return best;
+}
+
+/// @brief times making the same building from a layout compiled from its map, mapped once the way a batch shares it
+/// @param seed seeds the buildings
+/// @param ops buildings made per repetition
+/// @return the fastest repetition in seconds
+static double benchBuildFromLayout(uint64_t seed, long ops)
+{
+  BuildingMap *map = NULL;
+  benchMap(BENCH_BUILD_ROOMS, &map);
+  char path[] = "/tmp/a5benchXXXXXX";
+  int fd = mkstemp(path);
+  BuildingLayout *layout = NULL;
+  bool ok = fd >= 0 && compileLayout(map, path) == 0 && openLayout(path, &layout) == 0;
+  if (fd >= 0)
+  {
+    close(fd);
+    unlink(path);
+  }
+  cleanupMap(map);
+  if (!ok)
+  {
+    fprintf(stderr, "could not compile a layout into %s\n", path);
+    exit(1);
+  }
+
+  double best = INFINITY;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+  {
+    double start = benchTime();
+    for (long i = 0; i < ops; i++)
+    {
+      BuildingType *b = NULL;
+      initBuilding(&b, seed);
+      buildFromLayout(b, layout);
+      sink += b->spawn->id;
+      cleanupBuilding(b);
+    }
+    double t = benchTime() - start;
+    best = t < best ? t : best;
+  }
+  closeLayout(layout);
+  return best;
+}
+
+/// @brief runs whole hunts one after another for about the given time and writes their rate as a JSON object
+/// @param out the file written to
+/// @param first whether this is the first result, the rest are preceded by a comma
+/// @param rooms rooms in the building, 0 uses the default house
+/// @param hunters hunters sent in
+/// @param ghosts ghosts haunting it
+/// @param ticks run the hunts in lock step ticks instead of by wake up
+/// @param seed seed of the first hunt, every later one uses the next
+/// @param seconds how long to keep running hunts, at least 3 are run
+static void benchHunts(FILE *out, bool first, int rooms, int hunters, int ghosts, bool ticks, uint64_t seed, double seconds)
+{
+  BuildingMap *map = NULL;
+  if (rooms > 0)
+  {
+    benchMap(rooms, &map);
+  }
+  SimOptions opts = {map, NULL, hunters, ghosts, ticks};
+  SimResult result;
+  initSimResult(&result);
+  long runs = 0;
+  long long steps = 0;
+  double start = benchTime();
+  double t = 0;
+  while (runs < 3 || t < seconds)
+  {
+    runSimulation(seed + runs, &opts, &result);
+    runs++;
+    steps += result.steps;
+    t = benchTime() - start;
+  }
+  cleanupSimResult(&result);
+  if (map != NULL)
+  {
+    cleanupMap(map);
+  }
+
+  int roomCount = rooms > 0 ? rooms : 14;
+  const char *mode = ticks ? "ticks" : "events";
+  fprintf(out, "%s\n    {\"mode\": \"%s\", \"rooms\": %d, \"hunters\": %d, \"ghosts\": %d, \"runs\": %ld, \"sims_per_sec\": %.3f, \"steps_per_sec\": %.1f}",
+          first ? "" : ",", mode, roomCount, hunters, ghosts, runs, runs / t, steps / t);
+  fprintf(stderr, "%-6s %6d rooms %5d hunters %3d ghosts %10.1f sims/s %12.0f steps/s\n", mode, roomCount, hunters, ghosts, runs / t, steps / t);
+}
+
+int main(int argc, char *argv[])
+{
+  uint64_t seed = 42;
+  double seconds = BENCH_SECONDS;
+  const char *outPath = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:s:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      outPath = optarg;
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-o file] [-s seed] [-t seconds]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if (outPath != NULL && (out = fopen(outPath, "w")) == NULL)
+  {
+    fprintf(stderr, "could not write %s\n", outPath);
+    return 1;
+  }
+
+  logLevel = LOG_NONE;
+  startLog();
+
+  static const struct
+  {
+    const char *name;
+    double (*run)(uint64_t, long);
+    long ops;
+  } micro[] = {
+      {"findRandRoom", benchFindRandRoom, 10000000},
+      {"allocEvidence", benchAllocEvidence, 1000000},
+      {"isGhostly", benchIsGhostly, 10000000},
+      {"classifyGhostly", benchClassifyGhostly, 16000000},
+      {"delEvidence", benchDelEvidence, 1000000},
+      {"collectEvidence", benchCollectEvidence, 1000000},
+      {"shareGhostlyEvidence", benchShareEvidence, 1000000},
+      {"buildFromMap", benchBuildFromMap, 200},
+      {"buildFromLayout", benchBuildFromLayout, 200},
+  };
+  // rooms, hunters, ghosts and whether to run in lock step ticks
+  static const int macro[][4] = {
+      {0, 4, 1, 0},
+      {0, 16, 4, 0},
+      {100, 4, 1, 0},
+      {100, 64, 8, 0},
+      {1000, 64, 8, 0},
+      {1000, 1000, 16, 0},
+      {1000, 1000, 16, 1},
+      {10000, 1000, 16, 0},
+      {10000, 5000, 16, 0},
+      {10000, 5000, 16, 1},
+  };
+
+  fprintf(out, "{\"version\": 1, \"seed\": %llu,\n  \"micro\": [", (unsigned long long)seed);
+  for (size_t i = 0; i < sizeof(micro) / sizeof(micro[0]); i++)
+  {
+    writeMicro(out, i == 0, micro[i].name, micro[i].ops, micro[i].run(seed, micro[i].ops));
+  }
+  fprintf(out, "\n  ],\n  \"macro\": [");
+  for (size_t i = 0; i < sizeof(macro) / sizeof(macro[0]); i++)
+  {
+    benchHunts(out, i == 0, macro[i][0], macro[i][1], macro[i][2], macro[i][3], seed, seconds);
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  stopLog();
+  if (out != stdout)
+  {
+    fclose(out);
+  }
+  return 0;
+}
@@ -20,158 +20,240 @@
 
 /// @brief initialize a building and its member attributes by calling existing functions 
 /// @param b double pointer to which the new initalized building will be stored 
+/// @param seed seed of the buildings generator, every hunter and ghost splits its own stream from it
 
-void initBuilding(BuildingType **b)
+void initBuilding(BuildingType **b, uint64_t seed)
 {
     (*b) = calloc(1, sizeof(BuildingType));
 
-    RoomList *r = NULL;
-    initRoomList(&r);
-
     HunterNotebook *h = NULL;
     initNotebook(&h);
 
-    EvidenceList *e = NULL;
-    initEvidenceList(&e);
+    EvidenceLog *e = NULL;
+    initEvidenceLog(&e);
 
-    (*b)->rooms = r;
+    (*b)->rooms = NULL;
     (*b)->noteBook = h;
-    (*b)->ghost = NULL;
+    (*b)->ghosts = NULL;
+    (*b)->ghostCount = 0;
+    (*b)->ghostCapacity = 0;
+    (*b)->spawn = NULL;
+    (*b)->roomCount = 0;
+    (*b)->roomIndex = NULL;
+    (*b)->names = NULL;
+    (*b)->adjOffset = NULL;
+    (*b)->adjRooms = NULL;
+    (*b)->layout = NULL;
     (*b)->evidence = e;
+    (*b)->seed = seed;
+    (*b)->trace = NULL;
+    memset(&(*b)->table, 0, sizeof(EntityTable));
+    atomic_init(&(*b)->table.team, 0);
+    defaultConfig(&(*b)->config);
+    seedRand(&(*b)->rng, seed);
+}
+
+/// @brief makes room for an entity in the entity table of a building, doubling every array when it is full, and gives it its starting state
+/// @param b the building
+/// @param id the id of the hunter or ghost
+/// @param room the room it starts in
+void addEntity(BuildingType *b, int id, RoomType *room)
+{
+    EntityTable *t = &b->table;
+    if (id >= t->capacity)
+    {
+        int capacity = t->capacity == 0 ? NOTEBOOK_START : t->capacity;
+        while (capacity <= id)
+        {
+            capacity *= 2;
+        }
+        t->fear = realloc(t->fear, capacity * sizeof(int));
+        t->boredom = realloc(t->boredom, capacity * sizeof(int));
+        t->known = realloc(t->known, capacity * sizeof(atomic_uint));
+        t->found = realloc(t->found, capacity * sizeof(int));
+        t->room = realloc(t->room, capacity * sizeof(RoomType *));
+        t->ghostsHere = realloc(t->ghostsHere, capacity * sizeof(int));
+        t->check = realloc(t->check, capacity);
+        t->exitCheck = realloc(t->exitCheck, capacity);
+        t->capacity = capacity;
+    }
+    t->fear[id] = 0;
+    t->boredom[id] = b->config.boredomMax;
+    atomic_init(&t->known[id], 0);
+    t->found[id] = 0;
+    t->room[id] = room;
+    t->ghostsHere[id] = 0;
+    t->check[id] = CHECK_ACT;
+    t->exitCheck[id] = CHECK_ACT;
+}
+
+/// @brief counts the kinds of ghostly evidence a hunter knows of
+/// @param b the building
+/// @param id the id of the hunter
+/// @return the number of bits set in its known bits
+int knownKinds(BuildingType *b, int id)
+{
+    return __builtin_popcount(atomic_load_explicit(&b->table.known[id], memory_order_relaxed));
 }
 
 /// @brief clean up building and its initialized member attributes by using existing functions 
 /// @param b pointer tobuilding to be cleaned 
 
 void cleanupBuilding(BuildingType *b){
-    cleanupGhost(b->ghost);
-    cleanupRoomList(b->rooms);
+    for (int i = 0; i < b->ghostCount; i++)
+    {
+        cleanupGhost(b->ghosts[i]);
+    }
+    free(b->ghosts);
+    for (int i = 0; i < b->roomCount; i++)
+    {
+        cleanupRoom(&b->rooms[i]);
+    }
+    free(b->rooms);
     cleanupHunters(b->noteBook);
-    cleanupEvidenceList(b->evidence);
+    cleanupEvidenceLog(b->evidence);
+    free(b->roomIndex);
+    // a layout keeps its names and adjacency, it is shared by every building made from it
+    if (b->layout == NULL)
+    {
+        free(b->names);
+        free((int *)b->adjOffset);
+        free((int *)b->adjRooms);
+    }
+    free(b->table.fear);
+    free(b->table.boredom);
+    free(b->table.known);
+    free(b->table.found);
+    free(b->table.room);
+    free(b->table.ghostsHere);
+    free(b->table.check);
+    free(b->table.exitCheck);
     free(b);
 
 }
 
-/// @brief populate building with rooms, and connect these rooms and print the connections 
+// the default house, rooms are connected by their position in houseNames
+static char houseNames[][MAX_STR] = {
+    "Van",
+    "Hallway",
+    "Master Bedroom",
+    "Boy's Room",
+    "Bathroom",
+    "Basement",
+    "Basement Hallway",
+    "Right Storage Room",
+    "Left Storage Room",
+    "Kitchen",
+    "Living Room",
+    "Garage",
+    "Utility Room",
+    "Front Yard",
+};
+
+static int houseEdges[][2] = {
+    {1, 0},   // Hallway - Van
+    {1, 2},   // Hallway - Master Bedroom
+    {1, 3},   // Hallway - Boy's Room
+    {1, 4},   // Hallway - Bathroom
+    {1, 9},   // Hallway - Kitchen
+    {1, 5},   // Hallway - Basement
+    {6, 5},   // Basement Hallway - Basement
+    {6, 7},   // Basement Hallway - Right Storage Room
+    {6, 8},   // Basement Hallway - Left Storage Room
+    {9, 10},  // Kitchen - Living Room
+    {9, 11},  // Kitchen - Garage
+    {11, 12}, // Garage - Utility Room
+    {13, 0},  // Front Yard - Van
+};
+
+/// @brief describes the default house as a map, its names and edges are static and must not be cleaned up
+/// @param map the map to fill in
+
+void houseMap(BuildingMap *map)
+{
+    map->roomCount = sizeof(houseNames) / sizeof(houseNames[0]);
+    map->names = houseNames;
+    map->edgeCount = sizeof(houseEdges) / sizeof(houseEdges[0]);
+    map->edges = houseEdges;
+    map->spawn = 0;
+}
+
+/// @brief populate building with the default house, connect its rooms and spawn the hunters in the van
 /// @param b building to be populated  
 
 void populateRooms(BuildingType *building)
 {
-    RoomType *room = NULL;
-    RoomNode *node = NULL;
-
-    initRoom("Van", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *van = node;
-    printRoom(node);
-
-    initRoom("Hallway", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *hallway = node;
-    printRoom(node);
-
-    initRoom("Master Bedroom", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *masterBedroom = node;
-    printRoom(node);
-
-    initRoom("Boy's Room", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *boysRoom = node;
-    printRoom(node);
-
-    initRoom("Bathroom", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *bathroom = node;
-    printRoom(node);
-
-    initRoom("Basement", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *basement = node;
-    printRoom(node);
-
-    initRoom("Basement Hallway", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *basementHallway = node;
-    printRoom(node);
-
-    initRoom("Right Storage Room", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *rightStorageRoom = node;
-    printRoom(node);
-
-    initRoom("Left Storage Room", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *leftStorageRoom = node;
-    printRoom(node);
-
-    initRoom("Kitchen", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *kitchen = node;
-    printRoom(node);
-
-    initRoom("Living Room", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *livingRoom = node;
-    printRoom(node);
-
-    initRoom("Garage", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *garage = node;
-    printRoom(node);
-
-    initRoom("Utility Room", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *utilityRoom = node;
-    printRoom(node);
-
-    initRoom("Front Yard", &room);
-    initRoomNode(room, &node);
-    appendRoom(node, building->rooms);
-    RoomNode *frontYard = node;
-    printRoom(node);
-
-    // Now connect the rooms. It is possible you do not need a separate
-    // function for this, but it is provided to give you a starting point.
-    connectRooms(hallway, van);
-    connectRooms(hallway, masterBedroom);
-    connectRooms(hallway, boysRoom);
-    connectRooms(hallway, bathroom);
-    connectRooms(hallway, kitchen);
-    connectRooms(hallway, basement);
-    connectRooms(basementHallway, basement);
-    connectRooms(basementHallway, rightStorageRoom);
-    connectRooms(basementHallway, leftStorageRoom);
-    connectRooms(kitchen, livingRoom);
-    connectRooms(kitchen, garage);
-    connectRooms(garage, utilityRoom);
-    connectRooms(frontYard, van);
-
-    printRooms(van);
-    printRooms(hallway);
-    printRooms(masterBedroom);
-    printRooms(boysRoom);
-    printRooms(bathroom);
-    printRooms(basement);
-    printRooms(basementHallway);
-    printRooms(rightStorageRoom);
-    printRooms(leftStorageRoom);
-    printRooms(kitchen);
-    printRooms(livingRoom);
-    printRooms(garage);
-    printRooms(utilityRoom);
-    printRoom(frontYard);
-}
\ No newline at end of file
+    BuildingMap house;
+    houseMap(&house);
+    buildFromMap(building, &house);
+}
+
+/// @brief allocates every room of a building in one zeroed block and indexes them by id, each still has to be set up with initRoom
+/// @param b the building, which must not have rooms yet
+/// @param count the number of rooms
+
+void initRooms(BuildingType *b, int count)
+{
+    b->roomCount = count;
+    b->rooms = calloc(count, sizeof(RoomType));
+    b->roomIndex = malloc(count * sizeof(RoomType *));
+    for (int i = 0; i < count; i++)
+    {
+        b->roomIndex[i] = &b->rooms[i];
+    }
+}
+
+/// @brief builds the compressed sparse row adjacency of the building: the neighbours of room i are
+///        adjRooms[adjOffset[i]] up to adjRooms[adjOffset[i + 1]], stored as room ids
+/// @param b building whose rooms have already been appended and numbered
+/// @param edges pairs of room ids, each connecting the two rooms in both directions
+/// @param edgeCount the number of pairs in edges
+
+void buildAdjacency(BuildingType *b, int (*edges)[2], int edgeCount)
+{
+    int n = b->roomCount;
+    int *offset = calloc(n + 1, sizeof(int));
+
+    // count the degree of every room, then prefix sum the counts into offsets
+    for (int i = 0; i < edgeCount; i++)
+    {
+        if (edges[i][0] != edges[i][1])
+        {
+            offset[edges[i][0] + 1]++;
+            offset[edges[i][1] + 1]++;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        offset[i + 1] += offset[i];
+    }
+
+    // fill each rooms slice in the order the edges were given
+    int *fill = malloc(n * sizeof(int));
+    memcpy(fill, offset, n * sizeof(int));
+    int *rooms = malloc((offset[n] > 0 ? offset[n] : 1) * sizeof(int));
+    for (int i = 0; i < edgeCount; i++)
+    {
+        int x = edges[i][0];
+        int y = edges[i][1];
+        if (x != y)
+        {
+            rooms[fill[x]++] = y;
+            rooms[fill[y]++] = x;
+        }
+    }
+    free(fill);
+    b->adjOffset = offset;
+    b->adjRooms = rooms;
+}
+
+/// @brief prints every room of the building and the rooms connected to it
+/// @param b building to be printed
+
+void printBuilding(BuildingType *b)
+{
+    for (int i = 0; i < b->roomCount; i++)
+    {
+        printRooms(b, b->roomIndex[i]);
+    }
+}
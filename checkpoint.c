@@ -0,0 +1,832 @@
+#include "defs.h"
+
+/*
+    Checkpoints of a hunt run on the scheduler, with -d or -k. A
+    checkpoint holds everything needed to carry on as if the hunt had
+    never stopped:
+
+        header    "GHCK", u8 version, u64 seed, u8 ticks,
+                  f64 clock, i64 steps, i64 next event seq,
+                  u32 size of the config, the SimConfig,
+                  the RandState of the building
+        building  u32 roomCount, roomCount x (u8 length, name),
+                  (roomCount + 1) x i32 adjOffset,
+                  adjOffset[roomCount] x i32 adjRooms, u32 spawn
+        hunters   u32 hunterCount, hunterCount x (u8 length, name,
+                  u8 equipment, RandState, i32 fear, i32 boredom,
+                  u32 known bits), u32 team bits
+        ghosts    u32 ghostCount, ghostCount x (u8 type, u32 room,
+                  RandState, i32 boredom, u8 foundHunterAgain,
+                  i32 evidenceDropped)
+                  one u8 per entity, set once it has left the hunt
+        rosters   for every room, u32 count, count x u32 hunter
+        evidence  u64 count, count x (u8 type, f32 value,
+                  i32 references, i32 ghost or -1, i32 owner entity)
+                  for every room and every [type][ghostly] bucket,
+                  u32 count, count x u32 evidence
+                  for every hunter, u32 count, count x u32 evidence
+        queue     u32 count, count x (f64 time, i64 seq, u32 entity)
+        footer    u64 FNV-1a hash of everything before it
+
+    Numbers are in the byte order of the machine, a checkpoint is meant
+    to be resumed where it was taken. Evidence is numbered by its place
+    in the evidence log, so evidence held by a room and a hunter at once
+    is written once and both lists point at it, and its reference count
+    has to come out the same once every list is rebuilt. Room rosters
+    keep their order, since hunters pick who to share with by position,
+    and so does the adjacency, since entities pick where to go by it.
+
+    The hunt only stops long enough to copy its state into memory. A
+    background thread hashes the copy and writes it in one sequential
+    write to PATH.tmp, flushes it to disk and renames it over PATH, so
+    a crash mid write leaves the last checkpoint whole. A checkpoint is
+    taken every time one comes due, even while the last is still being
+    written: it waits as the ready snapshot, replacing one the writer
+    has not picked up yet, so however far the hunt runs ahead of the
+    disk the writer always moves on to the latest state, and the end of
+    the hunt waits for it to be written.
+*/
+
+/// @brief makes room for n more bytes at the end of the snapshot, doubling it when it is full
+/// @param c the checkpoints
+/// @param n the number of bytes
+/// @return where the bytes go
+static unsigned char *reserve(Checkpoint *c, size_t n)
+{
+  CheckpointBuffer *b = &c->snap;
+  if (b->used + n > b->capacity)
+  {
+    while (b->used + n > b->capacity)
+    {
+      b->capacity = b->capacity == 0 ? 65536 : b->capacity * 2;
+    }
+    b->data = realloc(b->data, b->capacity);
+  }
+  unsigned char *p = b->data + b->used;
+  b->used += n;
+  return p;
+}
+
+/// @brief appends raw bytes to the snapshot
+/// @param c the checkpoints
+/// @param p the bytes
+/// @param n the number of bytes
+static void put(Checkpoint *c, const void *p, size_t n)
+{
+  memcpy(reserve(c, n), p, n);
+}
+
+/// @brief appends a u32 to the snapshot
+static void putU32(Checkpoint *c, uint32_t v)
+{
+  put(c, &v, sizeof(v));
+}
+
+/// @brief appends an i32 to the snapshot
+static void putI32(Checkpoint *c, int32_t v)
+{
+  put(c, &v, sizeof(v));
+}
+
+/// @brief appends a single byte to the snapshot
+static void putByte(Checkpoint *c, unsigned char v)
+{
+  put(c, &v, 1);
+}
+
+/// @brief appends a short length prefixed string to the snapshot
+/// @param c the checkpoints
+/// @param s the string, at most 255 bytes are kept
+static void putName(Checkpoint *c, const char *s)
+{
+  size_t len = strlen(s);
+  unsigned char n = len > 255 ? 255 : (unsigned char)len;
+  putByte(c, n);
+  put(c, s, n);
+}
+
+/// @brief appends an evidence list to the snapshot as the log positions of its evidence
+/// @param c the checkpoints
+/// @param l the list
+static void putList(Checkpoint *c, EvidenceList *l)
+{
+  uint32_t count = 0;
+  for (EvidenceNode *n = l->head; n != NULL; n = n->next)
+  {
+    count++;
+  }
+  putU32(c, count);
+  for (EvidenceNode *n = l->head; n != NULL; n = n->next)
+  {
+    putU32(c, (uint32_t)n->evidence->logIndex);
+  }
+}
+
+/// @brief FNV-1a hash of a run of bytes
+/// @param p the bytes
+/// @param n the number of bytes
+/// @return the hash
+static uint64_t hashBytes(const unsigned char *p, size_t n)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < n; i++)
+  {
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/// @brief copies the whole state of a hunt into the snapshot, between two steps
+/// @param c the checkpoints
+/// @param s the scheduler running the hunt
+static void takeSnapshot(Checkpoint *c, Scheduler *s)
+{
+  BuildingType *b = c->building;
+  int hunters = b->noteBook->count;
+  int entities = hunters + b->ghostCount;
+  c->snap.used = 0;
+
+  put(c, CHECKPOINT_MAGIC, 4);
+  putByte(c, CHECKPOINT_VERSION);
+  put(c, &b->seed, sizeof(b->seed));
+  putByte(c, s->left != NULL);
+  put(c, &s->now, sizeof(s->now));
+  int64_t steps = s->steps, seq = s->seq;
+  put(c, &steps, sizeof(steps));
+  put(c, &seq, sizeof(seq));
+  putU32(c, sizeof(SimConfig));
+  put(c, &b->config, sizeof(SimConfig));
+  put(c, &b->rng, sizeof(RandState));
+
+  putU32(c, b->roomCount);
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    putName(c, b->roomIndex[i]->name);
+  }
+  put(c, b->adjOffset, (b->roomCount + 1) * sizeof(int));
+  put(c, b->adjRooms, b->adjOffset[b->roomCount] * sizeof(int));
+  putU32(c, b->spawn->id);
+
+  EntityTable *t = &b->table;
+  putU32(c, hunters);
+  for (int i = 0; i < hunters; i++)
+  {
+    HunterType *h = b->noteBook->hunters[i];
+    putName(c, h->name);
+    putByte(c, h->equipment);
+    put(c, &h->rng, sizeof(RandState));
+    putI32(c, t->fear[i]);
+    putI32(c, t->boredom[i]);
+    putU32(c, atomic_load_explicit(&t->known[i], memory_order_relaxed));
+  }
+  putU32(c, atomic_load_explicit(&t->team, memory_order_relaxed));
+  putU32(c, b->ghostCount);
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    GhostType *g = b->ghosts[i];
+    putByte(c, g->type);
+    putU32(c, g->room->id);
+    put(c, &g->rng, sizeof(RandState));
+    putI32(c, t->boredom[g->id]);
+    putByte(c, g->foundHunterAgain);
+    putI32(c, g->evidenceDropped);
+  }
+
+  // running by wake up, an entity has left once it is no longer queued
+  unsigned char *left = reserve(c, entities);
+  if (s->left != NULL)
+  {
+    for (int i = 0; i < entities; i++)
+    {
+      left[i] = s->left[i];
+    }
+  }
+  else
+  {
+    memset(left, 1, entities);
+    for (int i = 0; i < s->size; i++)
+    {
+      SimEvent *e = &s->heap[i];
+      left[e->kind == HUNTER_ENTITY ? ((HunterType *)e->entity)->id : ((GhostType *)e->entity)->id] = 0;
+    }
+  }
+
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    HunterNotebook *n = &b->roomIndex[i]->hunters;
+    putU32(c, n->count);
+    for (int j = 0; j < n->count; j++)
+    {
+      putU32(c, n->hunters[j]->id);
+    }
+  }
+
+  // a standard reading belongs to the pool of the hunter that took it, and only that hunter holds it
+  long count = evidenceLogSize(b->evidence);
+  if (count > c->ownerCount)
+  {
+    c->owner = realloc(c->owner, count * sizeof(int));
+    c->ownerCount = count;
+  }
+  for (long i = 0; i < count; i++)
+  {
+    c->owner[i] = -1;
+  }
+  for (int i = 0; i < hunters; i++)
+  {
+    for (EvidenceNode *n = b->noteBook->hunters[i]->evidence->head; n != NULL; n = n->next)
+    {
+      if (c->owner[n->evidence->logIndex] < 0)
+      {
+        c->owner[n->evidence->logIndex] = i;
+      }
+    }
+  }
+  uint64_t evidence = count;
+  put(c, &evidence, sizeof(evidence));
+  for (long i = 0; i < count; i++)
+  {
+    EvidenceType *e = evidenceLogAt(b->evidence, i);
+    putByte(c, e->type);
+    put(c, &e->value, sizeof(float));
+    putI32(c, e->refrences);
+    putI32(c, e->ghost != NULL ? e->ghost->index : -1);
+    putI32(c, e->ghost != NULL ? e->ghost->id : c->owner[i]);
+  }
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    for (int type = 0; type < NUM_EVIDENCE_TYPES; type++)
+    {
+      putList(c, &b->roomIndex[i]->evidence[type][0]);
+      putList(c, &b->roomIndex[i]->evidence[type][1]);
+    }
+  }
+  for (int i = 0; i < hunters; i++)
+  {
+    putList(c, b->noteBook->hunters[i]->evidence);
+  }
+
+  // the heap is written as it is, it is still a heap when read back in the same order
+  putU32(c, s->size);
+  for (int i = 0; i < s->size; i++)
+  {
+    SimEvent *e = &s->heap[i];
+    int64_t eventSeq = e->seq;
+    put(c, &e->time, sizeof(e->time));
+    put(c, &eventSeq, sizeof(eventSeq));
+    putU32(c, e->kind == HUNTER_ENTITY ? ((HunterType *)e->entity)->id : ((GhostType *)e->entity)->id);
+  }
+}
+
+/// @brief writes a snapshot, hashed, to PATH.tmp and renames it over PATH once it is on disk
+/// @param c the checkpoints
+/// @param b the snapshot
+static void writeSnapshot(Checkpoint *c, CheckpointBuffer *b)
+{
+  uint64_t hash = hashBytes(b->data, b->used);
+  char tmp[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", c->path);
+  FILE *f = fopen(tmp, "wb");
+  bool ok = f != NULL;
+  if (ok)
+  {
+    ok = fwrite(b->data, 1, b->used, f) == b->used;
+    ok = fwrite(&hash, sizeof(hash), 1, f) == 1 && ok;
+    ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp, c->path) == 0;
+  }
+  if (!ok)
+  {
+    atomic_fetch_add(&c->failed, 1);
+  }
+  c->written++;
+}
+
+/// @brief swaps two snapshots, so their memory is reused rather than copied
+static void swapSnapshots(CheckpointBuffer *a, CheckpointBuffer *b)
+{
+  CheckpointBuffer temp = *a;
+  *a = *b;
+  *b = temp;
+}
+
+/// @brief background thread writing the latest snapshot each time it is done with the last, until the hunt stops
+/// @param arg void pointer, will be typecasted to the Checkpoint
+static void *writeCheckpoints(void *arg)
+{
+  Checkpoint *c = (Checkpoint *)arg;
+  pthread_mutex_lock(&c->mutex);
+  while (true)
+  {
+    while (!c->hasReady && !c->stopping)
+    {
+      pthread_cond_wait(&c->wake, &c->mutex);
+    }
+    if (!c->hasReady)
+    {
+      break;
+    }
+    swapSnapshots(&c->ready, &c->out);
+    c->hasReady = false;
+    pthread_mutex_unlock(&c->mutex);
+    writeSnapshot(c, &c->out);
+    pthread_mutex_lock(&c->mutex);
+  }
+  pthread_mutex_unlock(&c->mutex);
+  return NULL;
+}
+
+/// @brief checkpoints a hunt run on a scheduler every so many simulated seconds from now on
+/// @param s the scheduler the hunt runs on
+/// @param b the building, every hunter and ghost must already be in it
+/// @param path the file checkpoints are written to, each replacing the last
+/// @param every simulated seconds between checkpoints
+/// @return 0 on success, otherwise -1 if nothing can be written next to path
+int startCheckpoints(Scheduler *s, BuildingType *b, const char *path, double every)
+{
+  char tmp[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *f = fopen(tmp, "wb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  fclose(f);
+  remove(tmp);
+
+  Checkpoint *c = calloc(1, sizeof(Checkpoint));
+  c->building = b;
+  c->path = strdup(path);
+  c->every = every;
+  c->due = s->now + every;
+  c->hasReady = false;
+  c->stopping = false;
+  c->owner = NULL;
+  atomic_init(&c->failed, 0);
+  pthread_mutex_init(&c->mutex, NULL);
+  pthread_cond_init(&c->wake, NULL);
+  c->started = pthread_create(&c->writer, NULL, writeCheckpoints, c) == 0;
+  s->checkpoint = c;
+  return 0;
+}
+
+/// @brief takes a checkpoint if one is due and hands it to the writer, replacing one it has not picked up yet, only call between steps
+/// @param s the scheduler, its checkpoint must be set
+void checkpointHunt(Scheduler *s)
+{
+  Checkpoint *c = s->checkpoint;
+  if (s->now < c->due)
+  {
+    return;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  takeSnapshot(c, s);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double pause = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  c->longestPause = pause > c->longestPause ? pause : c->longestPause;
+  c->taken++;
+  c->due = s->now + c->every;
+
+  if (!c->started)
+  {
+    writeSnapshot(c, &c->snap);
+    return;
+  }
+  // the writer always writes the latest snapshot, however far the hunt has got ahead of the disk
+  pthread_mutex_lock(&c->mutex);
+  swapSnapshots(&c->snap, &c->ready);
+  c->hasReady = true;
+  pthread_cond_signal(&c->wake);
+  pthread_mutex_unlock(&c->mutex);
+}
+
+/// @brief waits for the latest checkpoint to be written, prints how many were taken and stops checkpointing the hunt
+/// @param s the scheduler, nothing is done if it is not being checkpointed
+void stopCheckpoints(Scheduler *s)
+{
+  Checkpoint *c = s->checkpoint;
+  if (c == NULL)
+  {
+    return;
+  }
+  s->checkpoint = NULL;
+  if (c->started)
+  {
+    pthread_mutex_lock(&c->mutex);
+    c->stopping = true;
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->mutex);
+    pthread_join(c->writer, NULL);
+  }
+  printf("TOOK %ld CHECKPOINTS, WROTE %ld OF THEM INTO %s, THE LONGEST HELD THE HUNT UP FOR %.3f MS\n", c->taken, c->written, c->path,
+         c->longestPause * 1e3);
+  if (atomic_load(&c->failed) > 0)
+  {
+    fprintf(stderr, "could not write %d checkpoints to %s\n", atomic_load(&c->failed), c->path);
+  }
+  pthread_mutex_destroy(&c->mutex);
+  pthread_cond_destroy(&c->wake);
+  free(c->snap.data);
+  free(c->ready.data);
+  free(c->out.data);
+  free(c->owner);
+  free(c->path);
+  free(c);
+}
+
+/// @brief reads raw bytes of a checkpoint
+/// @param in the reader
+/// @param out where the bytes are copied, zeroed if the checkpoint ends first
+/// @param n the number of bytes
+static void take(TraceReader *in, void *out, size_t n)
+{
+  if (in->size - in->pos < n)
+  {
+    memset(out, 0, n);
+    in->pos = in->size;
+    in->bad = true;
+    return;
+  }
+  memcpy(out, in->data + in->pos, n);
+  in->pos += n;
+}
+
+/// @brief reads a u32 of a checkpoint
+static uint32_t takeU32(TraceReader *in)
+{
+  uint32_t v;
+  take(in, &v, sizeof(v));
+  return v;
+}
+
+/// @brief reads an i32 of a checkpoint
+static int32_t takeI32(TraceReader *in)
+{
+  int32_t v;
+  take(in, &v, sizeof(v));
+  return v;
+}
+
+/// @brief reads a single byte of a checkpoint
+static unsigned char takeByte(TraceReader *in)
+{
+  unsigned char v;
+  take(in, &v, 1);
+  return v;
+}
+
+/// @brief reads a count that is followed by at least size bytes for each, so a count bigger than the rest of the file is damage
+/// @param in the reader
+/// @param size the fewest bytes each counted item takes
+/// @return the count, 0 if it does not fit
+static uint32_t takeCount(TraceReader *in, size_t size)
+{
+  uint32_t n = takeU32(in);
+  if (n > (in->size - in->pos) / size)
+  {
+    in->bad = true;
+    return 0;
+  }
+  return n;
+}
+
+/// @brief reads a length prefixed name, cutting it down to fit if needed
+/// @param in the reader
+/// @param name where the name is stored, MAX_STR long
+static void takeName(TraceReader *in, char *name)
+{
+  size_t len = takeByte(in);
+  if (in->size - in->pos < len)
+  {
+    in->bad = true;
+    len = in->size - in->pos;
+  }
+  size_t keep = len < MAX_STR - 1 ? len : MAX_STR - 1;
+  memcpy(name, in->data + in->pos, keep);
+  name[keep] = '\0';
+  in->pos += len;
+}
+
+/// @brief rebuilds an evidence list from a checkpoint, taking new nodes from a pool
+/// @param in the reader
+/// @param l the list, empty
+/// @param all every piece of evidence restored so far, by log position
+/// @param count the number of pieces of evidence
+/// @param pool where the nodes come from, NULL takes them from the pool of the ghost that left the evidence
+/// @param room the room the list is in, NULL for the list of a hunter
+static void takeList(TraceReader *in, EvidenceList *l, EvidenceType **all, uint64_t count, EvidencePool *pool, RoomType *room)
+{
+  uint32_t n = takeCount(in, sizeof(uint32_t));
+  for (uint32_t i = 0; i < n && !in->bad; i++)
+  {
+    uint32_t id = takeU32(in);
+    if (id >= count || (pool == NULL && all[id]->ghost == NULL))
+    {
+      in->bad = true;
+      return;
+    }
+    EvidenceNode *node = NULL;
+    initEvidenceNode(pool != NULL ? pool : all[id]->ghost->pool, all[id], &node);
+    addEvidence(node, l);
+    if (room != NULL)
+    {
+      room->evidenceCount++;
+    }
+  }
+}
+
+/// @brief reads the hunters, ghosts, rosters, evidence and queue of a checkpoint into a building that has its rooms
+/// @param in the reader, just past the building
+/// @param b the building
+/// @param s the scheduler, its clock already set
+/// @param ticks whether the hunt runs by runTicks
+/// @return 0 on success, otherwise -1 if the checkpoint is damaged
+static int takeEntities(TraceReader *in, BuildingType *b, Scheduler *s, bool ticks)
+{
+  EntityTable *t = &b->table;
+  uint32_t hunters = takeCount(in, 2 + sizeof(RandState) + 12);
+  for (uint32_t i = 0; i < hunters && !in->bad; i++)
+  {
+    char name[MAX_STR];
+    takeName(in, name);
+    unsigned char equipment = takeByte(in);
+    if (equipment >= NUM_EVIDENCE_TYPES)
+    {
+      return -1;
+    }
+    HunterType *h = NULL;
+    initHunter(name, equipment, b, &h);
+    take(in, &h->rng, sizeof(RandState));
+    t->fear[i] = takeI32(in);
+    t->boredom[i] = takeI32(in);
+    atomic_store(&t->known[i], takeU32(in));
+  }
+  atomic_store(&t->team, takeU32(in));
+  uint32_t ghosts = takeCount(in, 5 + sizeof(RandState) + 9);
+  for (uint32_t i = 0; i < ghosts && !in->bad; i++)
+  {
+    GhostType *g = NULL;
+    initGhost(b, &g);
+    g->type = takeByte(in);
+    uint32_t room = takeU32(in);
+    if (g->type >= NUM_GHOST_TYPES || room >= (uint32_t)b->roomCount)
+    {
+      return -1;
+    }
+    updateGhostRoom(g, b->roomIndex[room]);
+    take(in, &g->rng, sizeof(RandState));
+    t->boredom[g->id] = takeI32(in);
+    g->foundHunterAgain = takeByte(in);
+    g->evidenceDropped = takeI32(in);
+  }
+  int entities = hunters + ghosts;
+  unsigned char *left = calloc(entities + 1, 1);
+  take(in, left, entities);
+  if (ticks)
+  {
+    s->left = calloc(entities, sizeof(bool));
+    for (int i = 0; i < entities; i++)
+    {
+      s->left[i] = left[i];
+    }
+  }
+  free(left);
+  if (in->bad)
+  {
+    return -1;
+  }
+
+  // initHunter put every hunter in the spawn room, the rosters are rebuilt in the order they were in
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    b->roomIndex[i]->hunters.count = 0;
+    atomic_store_explicit(&b->roomIndex[i]->hunters.present, 0, memory_order_relaxed);
+  }
+  int placed = 0;
+  for (int i = 0; i < b->roomCount && !in->bad; i++)
+  {
+    RoomType *room = b->roomIndex[i];
+    uint32_t n = takeCount(in, sizeof(uint32_t));
+    for (uint32_t j = 0; j < n; j++)
+    {
+      uint32_t id = takeU32(in);
+      if (id >= hunters)
+      {
+        return -1;
+      }
+      HunterType *h = b->noteBook->hunters[id];
+      h->room = room;
+      t->room[id] = room;
+      h->roomSlot = addHunter(h, &room->hunters);
+      placed++;
+    }
+  }
+  if (in->bad || placed != (int)hunters)
+  {
+    return -1;
+  }
+
+  uint64_t count;
+  take(in, &count, sizeof(count));
+  if (count > (in->size - in->pos) / 17)
+  {
+    return -1;
+  }
+  EvidenceType **all = malloc((count + 1) * sizeof(EvidenceType *));
+  int *references = malloc((count + 1) * sizeof(int));
+  for (uint64_t i = 0; i < count; i++)
+  {
+    unsigned char type = takeByte(in);
+    float value;
+    take(in, &value, sizeof(value));
+    references[i] = takeI32(in);
+    int32_t ghost = takeI32(in);
+    int32_t owner = takeI32(in);
+    if (type >= NUM_EVIDENCE_TYPES || ghost < -1 || ghost >= (int32_t)ghosts || owner < 0 || owner >= entities)
+    {
+      in->bad = true;
+      count = i;
+      break;
+    }
+    EvidencePool *pool = owner < (int32_t)hunters ? b->noteBook->hunters[owner]->pool : b->ghosts[owner - hunters]->pool;
+    initEvidence(pool, type, value, &all[i]);
+    all[i]->ghost = ghost >= 0 ? b->ghosts[ghost] : NULL;
+    appendEvidenceLog(b->evidence, all[i]);
+  }
+  for (int i = 0; i < b->roomCount && !in->bad; i++)
+  {
+    for (int type = 0; type < NUM_EVIDENCE_TYPES; type++)
+    {
+      takeList(in, &b->roomIndex[i]->evidence[type][0], all, count, NULL, b->roomIndex[i]);
+      takeList(in, &b->roomIndex[i]->evidence[type][1], all, count, NULL, b->roomIndex[i]);
+    }
+  }
+  for (uint32_t i = 0; i < hunters && !in->bad; i++)
+  {
+    HunterType *h = b->noteBook->hunters[i];
+    takeList(in, h->evidence, all, count, h->pool, NULL);
+  }
+  // every list has been rebuilt, so each piece of evidence must be held as often as it was
+  for (uint64_t i = 0; i < count && !in->bad; i++)
+  {
+    if (all[i]->refrences != references[i])
+    {
+      in->bad = true;
+    }
+  }
+  free(all);
+  free(references);
+
+  uint32_t events = takeCount(in, 20);
+  for (uint32_t i = 0; i < events && !in->bad; i++)
+  {
+    SimEvent e;
+    int64_t seq;
+    take(in, &e.time, sizeof(e.time));
+    take(in, &seq, sizeof(seq));
+    uint32_t id = takeU32(in);
+    if (id >= (uint32_t)entities)
+    {
+      return -1;
+    }
+    e.seq = seq;
+    e.kind = id < hunters ? HUNTER_ENTITY : GHOST_ENTITY;
+    e.entity = id < hunters ? (void *)b->noteBook->hunters[id] : (void *)b->ghosts[id - hunters];
+    if (s->size == s->capacity)
+    {
+      s->capacity *= 2;
+      s->heap = realloc(s->heap, s->capacity * sizeof(SimEvent));
+    }
+    s->heap[s->size++] = e;
+  }
+  return in->bad ? -1 : 0;
+}
+
+/// @brief rebuilds a hunt from a checkpoint, ready to carry on where it was taken
+/// @param path the checkpoint file
+/// @param building double pointer to store the rebuilt building, with every hunter and ghost in it
+/// @param scheduler double pointer to store the scheduler, its queue filled in if the hunt ran by wake up and its left set if it ran by runTicks
+/// @return 0 on success, otherwise -1 if the file cannot be read or is not a whole checkpoint this build can resume
+int resumeCheckpoint(const char *path, BuildingType **building, Scheduler **scheduler)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *data = malloc(size > 0 ? size : 1);
+  if (size < 5 + (long)sizeof(uint64_t) || fread(data, 1, size, f) != (size_t)size)
+  {
+    free(data);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  uint64_t hash;
+  size -= sizeof(hash);
+  memcpy(&hash, data + size, sizeof(hash));
+  if (hash != hashBytes(data, size) || memcmp(data, CHECKPOINT_MAGIC, 4) != 0 || data[4] != CHECKPOINT_VERSION)
+  {
+    free(data);
+    return -1;
+  }
+  TraceReader in = {data, (size_t)size, 5, false};
+
+  uint64_t seed;
+  double now;
+  int64_t steps, seq;
+  SimConfig config;
+  RandState rng;
+  take(&in, &seed, sizeof(seed));
+  bool ticks = takeByte(&in) != 0;
+  take(&in, &now, sizeof(now));
+  take(&in, &steps, sizeof(steps));
+  take(&in, &seq, sizeof(seq));
+  if (takeU32(&in) != sizeof(SimConfig))
+  {
+    free(data);
+    return -1;
+  }
+  take(&in, &config, sizeof(config));
+  take(&in, &rng, sizeof(rng));
+
+  // the rooms are built without connections, the adjacency is read in as it was
+  BuildingMap map = {0, NULL, 0, NULL, 0};
+  map.roomCount = takeCount(&in, 1 + sizeof(uint32_t));
+  map.names = malloc((map.roomCount + 1) * sizeof(*map.names));
+  for (int i = 0; i < map.roomCount; i++)
+  {
+    takeName(&in, map.names[i]);
+  }
+  int *adjOffset = malloc((map.roomCount + 1) * sizeof(int));
+  take(&in, adjOffset, (map.roomCount + 1) * sizeof(int));
+  for (int i = 0; i < map.roomCount; i++)
+  {
+    if (adjOffset[i] < 0 || adjOffset[i + 1] < adjOffset[i])
+    {
+      in.bad = true;
+    }
+  }
+  int neighbours = in.bad || adjOffset[0] != 0 || (size_t)adjOffset[map.roomCount] > (in.size - in.pos) / sizeof(int) ? -1 : adjOffset[map.roomCount];
+  int *adjRooms = malloc((neighbours > 0 ? neighbours : 1) * sizeof(int));
+  if (neighbours < 0)
+  {
+    in.bad = true;
+  }
+  else
+  {
+    take(&in, adjRooms, neighbours * sizeof(int));
+  }
+  for (int i = 0; i < neighbours; i++)
+  {
+    if (adjRooms[i] < 0 || adjRooms[i] >= map.roomCount)
+    {
+      in.bad = true;
+    }
+  }
+  map.spawn = takeU32(&in);
+  if (in.bad || map.roomCount == 0 || (uint32_t)map.spawn >= (uint32_t)map.roomCount || checkConfig(&config) != NULL)
+  {
+    free(map.names);
+    free(adjOffset);
+    free(adjRooms);
+    free(data);
+    return -1;
+  }
+
+  BuildingType *b = NULL;
+  initBuilding(&b, seed);
+  b->config = config;
+  buildFromMap(b, &map);
+  free(map.names);
+  free((int *)b->adjOffset);
+  free((int *)b->adjRooms);
+  b->adjOffset = adjOffset;
+  b->adjRooms = adjRooms;
+
+  Scheduler *s = NULL;
+  initScheduler(&s);
+  s->now = now;
+  s->steps = steps;
+  s->seq = seq;
+  if (takeEntities(&in, b, s, ticks) != 0 || in.pos != in.size)
+  {
+    cleanupScheduler(s);
+    cleanupBuilding(b);
+    free(data);
+    return -1;
+  }
+  // every hunter and ghost split its stream off the building before it was saved
+  b->rng = rng;
+  free(data);
+  *building = b;
+  *scheduler = s;
+  return 0;
+}
@@ -0,0 +1,248 @@
+#include "defs.h"
+
+/*
+    Tunable parameters of a hunt. Every building carries its own copy
+    of a SimConfig, so hunts with different parameters can run side by
+    side. Config files hold one parameter per line:
+
+        # comments and blank lines are ignored
+        fear_rate = 2
+        max_fear = 150
+        hunter_move_odds = 2
+
+    -P key=value sets a single parameter the same way. The action odds
+    are relative weights: a hunter with search, move and share odds of
+    1, 2 and 1 moves on half of its steps. A ghost uses its haunt odds
+    while it shares a room with a hunter, and its other odds otherwise.
+    The defaults are the values the hunt was written with, so a hunt
+    run with them draws exactly the same random numbers as before.
+*/
+
+// every parameter that can be set, where it lives in a SimConfig and whether it is a real number or an int
+static const ConfigKey configKeys[] = {
+    {"fear_rate", offsetof(SimConfig, fearRate), false},
+    {"max_fear", offsetof(SimConfig, maxFear), false},
+    {"boredom_max", offsetof(SimConfig, boredomMax), false},
+    {"found_kinds", offsetof(SimConfig, foundKinds), false},
+    {"hunter_sleep_min", offsetof(SimConfig, hunterSleepMin), true},
+    {"hunter_sleep_max", offsetof(SimConfig, hunterSleepMax), true},
+    {"ghost_sleep_min", offsetof(SimConfig, ghostSleepMin), true},
+    {"ghost_sleep_max", offsetof(SimConfig, ghostSleepMax), true},
+    {"hunter_search_odds", offsetof(SimConfig, hunterOdds[HUNTER_SEARCH]), false},
+    {"hunter_move_odds", offsetof(SimConfig, hunterOdds[HUNTER_MOVE]), false},
+    {"hunter_share_odds", offsetof(SimConfig, hunterOdds[HUNTER_SHARE]), false},
+    {"ghost_move_odds", offsetof(SimConfig, ghostOdds[GHOST_MOVE]), false},
+    {"ghost_drop_odds", offsetof(SimConfig, ghostOdds[GHOST_DROP]), false},
+    {"ghost_idle_odds", offsetof(SimConfig, ghostOdds[GHOST_IDLE]), false},
+    {"ghost_haunt_move_odds", offsetof(SimConfig, hauntOdds[GHOST_MOVE]), false},
+    {"ghost_haunt_drop_odds", offsetof(SimConfig, hauntOdds[GHOST_DROP]), false},
+    {"ghost_haunt_idle_odds", offsetof(SimConfig, hauntOdds[GHOST_IDLE]), false},
+};
+
+#define NUM_CONFIG_KEYS (int)(sizeof(configKeys) / sizeof(configKeys[0]))
+
+/// @brief fills a config with the default parameters
+/// @param c the config being filled
+void defaultConfig(SimConfig *c)
+{
+  memset(c, 0, sizeof(SimConfig));
+  c->fearRate = FEAR_RATE;
+  c->maxFear = MAX_FEAR;
+  c->boredomMax = BOREDOM_MAX;
+  c->foundKinds = FOUND_KINDS;
+  c->hunterSleepMin = HUNTER_SLEEP_MIN;
+  c->hunterSleepMax = HUNTER_SLEEP_MAX;
+  c->ghostSleepMin = GHOST_SLEEP_MIN;
+  c->ghostSleepMax = GHOST_SLEEP_MAX;
+  for (int i = 0; i < NUM_HUNTER_ACTIONS; i++)
+  {
+    c->hunterOdds[i] = 1;
+  }
+  for (int i = 0; i < NUM_GHOST_ACTIONS; i++)
+  {
+    c->ghostOdds[i] = 1;
+  }
+  // a ghost with company only ever drops evidence or waits
+  c->hauntOdds[GHOST_MOVE] = 0;
+  c->hauntOdds[GHOST_DROP] = 1;
+  c->hauntOdds[GHOST_IDLE] = 1;
+}
+
+/// @brief finds a parameter by name
+/// @param name the name of the parameter, as written in a config file
+/// @return the parameter, or NULL if there is none by that name
+const ConfigKey *findConfigKey(const char *name)
+{
+  for (int i = 0; i < NUM_CONFIG_KEYS; i++)
+  {
+    if (strcmp(configKeys[i].name, name) == 0)
+    {
+      return &configKeys[i];
+    }
+  }
+  return NULL;
+}
+
+/// @brief sets one parameter of a config to a number, rounding it for int parameters
+/// @param c the config
+/// @param key the parameter
+/// @param value the new value
+void setConfigValue(SimConfig *c, const ConfigKey *key, double value)
+{
+  char *field = (char *)c + key->offset;
+  if (key->real)
+  {
+    *(double *)field = value;
+  }
+  else
+  {
+    *(int *)field = (int)lround(value);
+  }
+}
+
+/// @brief reads one parameter of a config
+/// @param c the config
+/// @param key the parameter
+/// @return its value
+double getConfigValue(SimConfig *c, const ConfigKey *key)
+{
+  char *field = (char *)c + key->offset;
+  return key->real ? *(double *)field : *(int *)field;
+}
+
+/// @brief strips the whitespace around a string in place
+/// @param s the string
+/// @return the first character that is not whitespace
+static char *trim(char *s)
+{
+  while (*s == ' ' || *s == '\t')
+  {
+    s++;
+  }
+  char *end = s + strlen(s);
+  while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+  {
+    *--end = '\0';
+  }
+  return s;
+}
+
+/// @brief splits a "key = value" line in place
+/// @param line the line, modified
+/// @param key where the start of the trimmed key is stored
+/// @param value where the start of the trimmed value is stored
+/// @return 0 on success, otherwise -1 if there is no '='
+int splitConfigLine(char *line, char **key, char **value)
+{
+  char *eq = strchr(line, '=');
+  if (eq == NULL)
+  {
+    return -1;
+  }
+  *eq = '\0';
+  *key = trim(line);
+  *value = trim(eq + 1);
+  return 0;
+}
+
+/// @brief sets a parameter from a "key=value" string, as given with -P
+/// @param c the config
+/// @param option the string
+/// @return 0 on success, otherwise -1 if the key is unknown or the value is not a number
+int setConfigOption(SimConfig *c, const char *option)
+{
+  char line[CONFIG_LINE];
+  snprintf(line, sizeof(line), "%s", option);
+  char *key, *value, *after;
+  if (splitConfigLine(line, &key, &value) != 0)
+  {
+    return -1;
+  }
+  const ConfigKey *k = findConfigKey(key);
+  double v = strtod(value, &after);
+  if (k == NULL || after == value || *after != '\0')
+  {
+    return -1;
+  }
+  setConfigValue(c, k, v);
+  return 0;
+}
+
+/// @brief reads a config file on top of a config, parameters it does not mention keep their value
+/// @param path the path of the config file
+/// @param c the config being set
+/// @return 0 on success, otherwise -1 if the file could not be read or a line is malformed
+int loadConfig(const char *path, SimConfig *c)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  char line[CONFIG_LINE];
+  int result = 0;
+  while (result == 0 && fgets(line, sizeof(line), f) != NULL)
+  {
+    char *p = trim(line);
+    if (*p == '\0' || *p == '#')
+    {
+      continue;
+    }
+    result = setConfigOption(c, p);
+  }
+  fclose(f);
+  return result;
+}
+
+/// @brief checks that a config describes a hunt that can be run
+/// @param c the config
+/// @return NULL if it can, otherwise what is wrong with it
+const char *checkConfig(SimConfig *c)
+{
+  if (c->fearRate < 0 || c->maxFear < 1 || c->boredomMax < 1)
+  {
+    return "fear_rate must not be negative, max_fear and boredom_max must be positive";
+  }
+  if (c->foundKinds < 1 || c->foundKinds > NUM_EVIDENCE_TYPES)
+  {
+    return "found_kinds must be between 1 and 4";
+  }
+  if (c->hunterSleepMin < 0 || c->hunterSleepMax < c->hunterSleepMin || c->ghostSleepMin < 0 || c->ghostSleepMax < c->ghostSleepMin)
+  {
+    return "sleeps must not be negative and each min must not be above its max";
+  }
+  int hunter = 0, ghost = 0, haunt = 0;
+  for (int i = 0; i < NUM_HUNTER_ACTIONS; i++)
+  {
+    if (c->hunterOdds[i] < 0)
+    {
+      return "odds must not be negative";
+    }
+    hunter += c->hunterOdds[i];
+  }
+  for (int i = 0; i < NUM_GHOST_ACTIONS; i++)
+  {
+    if (c->ghostOdds[i] < 0 || c->hauntOdds[i] < 0)
+    {
+      return "odds must not be negative";
+    }
+    ghost += c->ghostOdds[i];
+    haunt += c->hauntOdds[i];
+  }
+  if (hunter == 0 || ghost == 0 || haunt == 0)
+  {
+    return "the hunter, ghost and ghost haunt odds each need one that is not 0";
+  }
+  return NULL;
+}
+
+/// @brief writes every parameter of a config in the config file format, so it can be loaded again
+/// @param c the config
+/// @param out where it is written
+void printConfig(SimConfig *c, FILE *out)
+{
+  for (int i = 0; i < NUM_CONFIG_KEYS; i++)
+  {
+    fprintf(out, "%s = %g\n", configKeys[i].name, getConfigValue(c, &configKeys[i]));
+  }
+}
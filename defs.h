@@ -7,13 +7,95 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define MAX_STR 64
+// FEAR_RATE, MAX_FEAR, BOREDOM_MAX, FOUND_KINDS and the sleeps are the defaults of the SimConfig of a building, see config.c
 #define FEAR_RATE 1
 #define MAX_FEAR 100
-#define MAX_HUNTERS 4
-#define USLEEP_TIME 50000
+#define DEFAULT_HUNTERS 4
+#define DEFAULT_GHOSTS 1
+#define NOTEBOOK_START 4
 #define BOREDOM_MAX 99
+// kinds of ghostly evidence a hunter has to know of to leave having found the ghost
+#define FOUND_KINDS 3
+#define POOL_BLOCK_SIZE 16384
+#define LOG_FIRST_SEGMENT 1024
+#define LOG_MAX_SEGMENTS 32
+// seconds an entity waits between actions, chosen uniformly in [MIN, MAX]
+#define HUNTER_SLEEP_MIN 0.2
+#define HUNTER_SLEEP_MAX 1
+#define GHOST_SLEEP_MIN 0.5
+#define GHOST_SLEEP_MAX 1
+
+/* functions.c */
+
+// xoshiro256** generator state, every entity owns one so no draws are shared between threads
+typedef struct RandState
+{
+  uint64_t s[4];
+} RandState;
+
+void seedRand(RandState *, uint64_t);
+uint64_t nextRand(RandState *);
+void splitRand(RandState *, RandState *);
+int randInt(RandState *, int, int);
+float randFloat(RandState *, float, float);
+int pickOdds(RandState *, const int *, int);
+
+/* log.c */
+
+typedef enum
+{
+  LOG_NONE,
+  LOG_INFO,  // what every hunter and the ghost does
+  LOG_DEBUG  // spacing and other noise
+} LogLevel;
+
+// events above this level are compiled out entirely, build with -DLOG_COMPILE_LEVEL=LOG_NONE for a silent binary
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_RING_SIZE 65536
+#define LOG_WRITE_SIZE (1 << 20)
+#define LOG_MAX_LINE 256
+
+// one per logging thread, only its thread advances head and only the writer advances tail
+typedef struct LogRing
+{
+  char *data;
+  atomic_size_t head;
+  atomic_size_t tail;
+  struct LogRing *next;
+} LogRing;
+
+extern LogLevel logLevel;
+
+// the level check happens before any arguments are evaluated, so a filtered event costs one compare
+#define logEvent(level, ...)                                       \
+  do                                                               \
+  {                                                                \
+    if ((level) <= LOG_COMPILE_LEVEL && (level) <= logLevel)       \
+    {                                                              \
+      writeLog(__VA_ARGS__);                                       \
+    }                                                              \
+  } while (0)
+
+void startLog(void);
+void flushLog(void);
+void stopLog(void);
+void writeLog(const char *, ...);
 
 // You may rename these types if you wish
 typedef enum
@@ -24,6 +106,8 @@ typedef enum
   SOUND
 } EvidenceClassType;
 
+#define NUM_EVIDENCE_TYPES 4
+
 const char *evidenceEnumToStr(EvidenceClassType);
 
 typedef enum
@@ -34,6 +118,8 @@ typedef enum
   PHANTOM
 } GhostClassType;
 
+const char *ghostEnumToStr(GhostClassType);
+
 /* evidence.c */
 
 typedef struct EvidenceType
@@ -41,11 +127,11 @@ typedef struct EvidenceType
   EvidenceClassType type;
   float value;
   int refrences;
+  int logIndex;            // its position in the evidence log of the building, how checkpoints refer to it
+  struct GhostType *ghost; // the ghost that left it, NULL for standard readings
 } EvidenceType;
 
-void initEvidence(EvidenceClassType, float, EvidenceType **);
 bool isGhostly(EvidenceType *);
-void cleanupEvidence(EvidenceType *);
 
 typedef struct EvidenceNode
 {
@@ -54,9 +140,27 @@ typedef struct EvidenceNode
   struct EvidenceNode *prev;
 } EvidenceNode;
 
-void initEvidenceNode(EvidenceType *, EvidenceNode **);
-void copyEvidence(EvidenceType *, EvidenceNode **);
-void cleanupEvidenceNode(EvidenceNode *);
+// slab allocator for evidence and nodes, each entity owns one so only its own thread touches it
+typedef struct PoolBlock
+{
+  struct PoolBlock *next;
+  char data[];
+} PoolBlock;
+
+typedef struct EvidencePool
+{
+  PoolBlock *blocks;
+  char *next;
+  char *end;
+  EvidenceNode *freeNodes;
+} EvidencePool;
+
+void initPool(EvidencePool **);
+void cleanupPool(EvidencePool *);
+void initEvidence(EvidencePool *, EvidenceClassType, float, EvidenceType **);
+void initEvidenceNode(EvidencePool *, EvidenceType *, EvidenceNode **);
+void copyEvidence(EvidencePool *, EvidenceType *, EvidenceNode **);
+void cleanupEvidenceNode(EvidencePool *, EvidenceNode *);
 
 typedef struct EvidenceList
 {
@@ -66,10 +170,30 @@ typedef struct EvidenceList
 
 void initEvidenceList(EvidenceList **);
 void addEvidence(EvidenceNode *, EvidenceList *);
-int delEvidence(EvidenceNode *, EvidenceList *);
-void cleanupEvidenceNodes(EvidenceList *);
+int delEvidence(EvidenceNode *, EvidenceList *, EvidencePool *);
 void cleanupEvidenceList(EvidenceList *);
 
+// append only log of every piece of evidence in a building, segment k holds LOG_FIRST_SEGMENT << k entries
+typedef _Atomic(EvidenceType *) LogSlot;
+
+typedef struct EvidenceLog
+{
+  atomic_long count;
+  _Atomic(LogSlot *) segments[LOG_MAX_SEGMENTS];
+} EvidenceLog;
+
+void initEvidenceLog(EvidenceLog **);
+void cleanupEvidenceLog(EvidenceLog *);
+long appendEvidenceLog(EvidenceLog *, EvidenceType *);
+long evidenceLogSize(EvidenceLog *);
+EvidenceType *evidenceLogAt(EvidenceLog *, long);
+
+// readings countGhostlyLog copies out of the log and classifies at a time, a multiple of 64
+#define GHOSTLY_RUN 4096
+
+long classifyGhostly(const unsigned char *, const float *, long, uint64_t *);
+long countGhostlyLog(EvidenceLog *);
+
 void printEvidence(EvidenceNode *);
 void printEvidenceList(EvidenceList *);
 
@@ -79,119 +203,255 @@ typedef struct GhostType
 {
   GhostClassType type;
   struct RoomType *room;
-  int boredom;
-  struct BuildingType *building;
+  struct BuildingType *building; // its boredom is kept in the entity table of the building, by id
+  bool foundHunterAgain;
+  int evidenceDropped;
+  RandState rng;
+  EvidencePool *pool;
+  int id;
+  int index;      // position in the ghost roster of its building
+  bool identified; // set by identifyGhosts once the hunt is over
 } GhostType;
 
 void cleanupGhost(GhostType *);
 /* hunter.c*/
 
+// what a hunter does once it has checked its surroundings, worked out for many hunters at once by checkHunters
+typedef enum
+{
+  CHECK_ACT,    // carry on
+  CHECK_FEARED, // carry on, a ghost in the room scared it more
+  CHECK_BORED,  // leave bored
+  CHECK_FOUND,  // leave knowing FOUND_KINDS different kinds of ghostly evidence
+  CHECK_SCARED  // run away scared
+} HunterCheck;
+
 typedef struct HunterType
 {
   struct RoomType *room;
   EvidenceClassType equipment;
   struct EvidenceList *evidence;
   char name[MAX_STR];
-  int fear;
-  int boredom;
-  struct BuildingType *building;
-  int hasDifferentGhostly;
-  // types collected
-  int typesCollected[MAX_HUNTERS]; 
+  struct BuildingType *building; // its fear, boredom and ghostly knowledge are kept in the entity table of the building, by id
+  RandState rng;
+  EvidencePool *pool;
+  int id;
+  int roomSlot; // position in the notebook of its room
 } HunterType;
 
+// growable roster of hunters, doubling from NOTEBOOK_START once the first hunter is added
 typedef struct HunterNotebook
 {
-  HunterType *hunters[MAX_HUNTERS];
+  HunterType **hunters;
   int count;
+  int capacity;
+  atomic_int present; // count, for ghosts checking the room without its lock
 } HunterNotebook;
 
 void initNotebook(HunterNotebook **);
 void cleanupNotebook(HunterNotebook *);
-void addHunter(HunterType *, HunterNotebook *);
+int addHunter(HunterType *, HunterNotebook *);
 void removeHunter(HunterType *, HunterNotebook *);
 
 /* room.c */
 
 typedef struct RoomType
 {
-  char name[MAX_STR];
-  struct RoomList *rooms;
-  EvidenceList *evidence;
-  HunterNotebook *hunters;
-  struct GhostType *ghost;
-  sem_t mutex;
+  const char *name; // points into the room names of the building, or of the layout it was built from
+  int id;
+  // evidence left in the room, bucketed by [EvidenceClassType][isGhostly]
+  EvidenceList evidence[NUM_EVIDENCE_TYPES][2];
+  int evidenceCount;
+  HunterNotebook hunters; // its roster is only allocated once a hunter enters
+  atomic_int ghosts; // how many ghosts are in the room
+  sem_t mutex;       // only taken through lockRoom and lockRooms
+  atomic_long locks;      // times the room was locked
+  atomic_long lockWaits;  // times locking it had to wait for another entity
+  atomic_long lockWaitNs; // nanoseconds spent waiting on it
 } RoomType;
 
-void initRoom(char *, RoomType **);
+void initRoom(const char *, int, RoomType *);
 bool collectEvidence(HunterType *);
+void addRoomEvidence(RoomType *, EvidenceNode *);
+bool hasEvidence(RoomType *);
 void cleanupRoom(RoomType *);
+void lockRoom(RoomType *);
+void unlockRoom(RoomType *);
+void lockRooms(RoomType *, RoomType *);
+void unlockRooms(RoomType *, RoomType *);
 
-typedef struct RoomNode
-{
-  RoomType *room;
-  struct RoomNode *next;
-  struct RoomNode *prev;
-} RoomNode;
-
-void initRoomNode(RoomType *, RoomNode **);
-void copyRoom(RoomType *, RoomNode **);
 bool hasHunters(RoomType *);
 bool hasGhost(RoomType *);
 bool hasHunter(RoomType *);
-void connectRooms(RoomNode *, RoomNode *);
-void cleanupRoomNode(RoomNode *);
-void printRoom(RoomNode *);
+void printRooms(struct BuildingType *, RoomType *);
+RoomType *findRandRoom(struct BuildingType *, RoomType *, RandState *);
+void printRoomLocks(struct BuildingType *);
+
+/* config.c */
 
-typedef struct RoomList
+// what a hunter does with a step, drawn with the hunterOdds of the config
+typedef enum
+{
+  HUNTER_SEARCH, // collect ghostly evidence in the room, or take a standard reading if there is none
+  HUNTER_MOVE,
+  HUNTER_SHARE
+} HunterAction;
+
+// what a ghost does with a step, drawn with the ghostOdds of the config, or the hauntOdds while a hunter is in its room
+typedef enum
 {
-  struct RoomNode *head;
-  struct RoomNode *tail;
-} RoomList;
+  GHOST_MOVE,
+  GHOST_DROP,
+  GHOST_IDLE
+} GhostAction;
 
-void initRoomList(RoomList **);
-void appendRoom(RoomNode *, RoomList *);
-RoomType *findRandRoom(RoomList *);
-void copyRoom(RoomType *e, RoomNode **node);
-void cleanupRoomNodes(RoomList *);
-void cleanupRoomList(RoomList *);
-void printRooms(RoomNode *);
+#define NUM_HUNTER_ACTIONS 3
+#define NUM_GHOST_ACTIONS 3
+#define CONFIG_LINE 256
+
+// the tunable parameters of a hunt, every building carries its own copy, see config.c
+typedef struct SimConfig
+{
+  int fearRate;   // fear every ghost in the room adds to a hunter each step
+  int maxFear;    // fear at which a hunter runs away
+  int boredomMax; // steps an entity lasts without anything happening
+  int foundKinds; // kinds of ghostly evidence a hunter needs to know of to leave having found the ghost
+  double hunterSleepMin, hunterSleepMax;
+  double ghostSleepMin, ghostSleepMax;
+  int hunterOdds[NUM_HUNTER_ACTIONS];
+  int ghostOdds[NUM_GHOST_ACTIONS];
+  int hauntOdds[NUM_GHOST_ACTIONS];
+} SimConfig;
+
+// a parameter of a SimConfig, by the name used in config files
+typedef struct ConfigKey
+{
+  const char *name;
+  size_t offset;
+  bool real; // a double, otherwise an int
+} ConfigKey;
+
+void defaultConfig(SimConfig *);
+const ConfigKey *findConfigKey(const char *);
+void setConfigValue(SimConfig *, const ConfigKey *, double);
+double getConfigValue(SimConfig *, const ConfigKey *);
+int splitConfigLine(char *, char **, char **);
+int setConfigOption(SimConfig *, const char *);
+int loadConfig(const char *, SimConfig *);
+const char *checkConfig(SimConfig *);
+void printConfig(SimConfig *, FILE *);
 
 /* building.c */
 
+// hot state of every hunter and ghost of a building as parallel arrays by entity id, so a tick over thousands
+// of hunters only streams through the few values it needs instead of dragging names and pointers through the cache
+typedef struct EntityTable
+{
+  int *fear;                // hunters only
+  int *boredom;             // hunters and ghosts
+  atomic_uint *known;       // hunters only, bit 1 << EvidenceClassType set for every kind of ghostly evidence it has collected or been told of
+  atomic_uint team;         // the known bits of every hunter ORed together
+  int *found;               // hunters only, kinds of ghostly evidence known, gathered from known before checkHunters runs
+  struct RoomType **room;   // hunters and ghosts, kept up to date by updateHunterRoom and updateGhostRoom
+  int *ghostsHere;          // hunters only, ghosts in their room, gathered before checkHunters runs
+  unsigned char *check;     // hunters only, the HunterCheck of the last checkHunters
+  unsigned char *exitCheck; // hunters only, the HunterCheck it left the hunt with, CHECK_ACT while it is still in it
+  int capacity;
+} EntityTable;
+
 typedef struct BuildingType
 {
-  RoomList *rooms;
+  RoomType *rooms; // every room by id, in one block
   HunterNotebook *noteBook;
-  GhostType *ghost;
-  EvidenceList *evidence;
+  GhostType **ghosts; // every ghost, in the order they were created
+  int ghostCount;
+  int ghostCapacity;
+  EvidenceLog *evidence;
+  RoomType *spawn;
+  int roomCount;
+  RoomType **roomIndex;      // rooms by id
+  char (*names)[MAX_STR];    // the room names, NULL when they are read from a layout
+  const int *adjOffset;      // CSR offsets into adjRooms, roomCount + 1 long
+  const int *adjRooms;       // ids of each rooms neighbours, back to back
+  const struct BuildingLayout *layout; // NULL unless the names and adjacency are shared from a mapped layout
+  uint64_t seed;
+  RandState rng;
+  struct Trace *trace; // NULL unless the hunt is being recorded
+  EntityTable table;
+  SimConfig config; // defaults until the caller sets it, which must be before any hunter or ghost is added
 } BuildingType;
 
 // building protos
 void createBuilding();
-void initBuilding(BuildingType **);
+void initBuilding(BuildingType **, uint64_t);
 void populateRooms(BuildingType *);
+void initRooms(BuildingType *, int);
+void buildAdjacency(BuildingType *, int (*)[2], int);
 void cleanupBuilding(BuildingType *);
+void addEntity(BuildingType *, int, RoomType *);
+int knownKinds(BuildingType *, int);
+void printBuilding(BuildingType *);
+
+/* map.c */
+
+typedef struct BuildingMap
+{
+  int roomCount;
+  char (*names)[MAX_STR];
+  int edgeCount;
+  int (*edges)[2];
+  int spawn;
+} BuildingMap;
+
+int loadMap(const char *, BuildingMap **);
+void cleanupMap(BuildingMap *);
+void buildFromMap(BuildingType *, BuildingMap *);
+void houseMap(BuildingMap *); // in building.c, beside the house it describes
+
+/* layout.c */
+
+#define LAYOUT_MAGIC "GHLY"
+#define LAYOUT_VERSION 1
+
+// a building compiled by compileLayout and mapped read only by openLayout, every pointer is into the mapping
+typedef struct BuildingLayout
+{
+  void *base;
+  size_t size;
+  int roomCount;
+  int spawn;
+  const uint32_t *names; // where the name of each room starts in strings
+  const char *strings;   // the room names, each terminated
+  const int *adjOffset;
+  const int *adjRooms;
+} BuildingLayout;
+
+int compileLayout(BuildingMap *, const char *);
+int openLayout(const char *, BuildingLayout **);
+void closeLayout(BuildingLayout *);
+void buildFromLayout(BuildingType *, const BuildingLayout *);
 
 // function protos for ghost
 void initGhost(BuildingType *, GhostType **);
-void *updateGhost(void *);
+bool stepGhost(GhostType *);
 void createEvidence(GhostType *);
+EvidenceType *dropEvidence(GhostType *, EvidenceClassType, float);
 void updateGhostRoom(GhostType *, RoomType *);
-
-// randint and float
-int randInt(int, int);
-float randFloat(float, float);
+int identifyGhosts(struct BuildingType *);
 
 // didnt know where to put these i just added, others i already added to the top UwU
-void *updateHunter(void *);
+bool stepHunter(HunterType *);
+void checkHunters(EntityTable *, SimConfig *, int, int);
+bool applyCheck(HunterType *);
+void actHunter(HunterType *);
 void updateHunterRoom(HunterType *, RoomType *);
-HunterType *pickRandomHunter(HunterNotebook *);
+HunterType *pickRandomHunter(HunterNotebook *, RandState *);
 
 void shareGhostlyEvidence(HunterType *, HunterType *);
 int ghostlyEvidenceCount(EvidenceList *);
 
 void generateStandardEvidence(HunterType *);
+EvidenceType *addStandardEvidence(HunterType *, float);
 
 void initHunter(char *, EvidenceClassType, BuildingType *, HunterType **);
 
@@ -201,8 +461,494 @@ void printHunters(HunterNotebook *);
 void printGhost(GhostType *);
 void cleanupHunter(HunterType *);
 void cleanupHunters(HunterNotebook *);
+void learnGhostly(HunterType *, EvidenceClassType);
+
+/* trace.c */
 
+#define TRACE_MAGIC "GHTR"
+#define TRACE_VERSION 3
+#define TRACE_BUFFER_SIZE 65536
+#define TRACE_MAX_EVENT 32
+
+typedef enum
+{
+  TRACE_MOVE,     // varint room
+  TRACE_DROP,     // u8 evidence type, f32 value, left in the ghosts room
+  TRACE_STANDARD, // f32 value, of the hunters equipment type
+  TRACE_COLLECT,  // nothing, the hunter takes the oldest ghostly evidence it can read in its room
+  TRACE_SHARE,    // varint hunter, learns every kind of ghostly evidence the sharer knows of
+  TRACE_FEAR,     // varint new fear
+  TRACE_EXIT      // u8 ExitReason
+} TraceOp;
+
+typedef enum
+{
+  EXIT_BORED,
+  EXIT_SCARED,
+  EXIT_FOUND
+} ExitReason;
 
-// new
- int findSizeOfAdjacentRooms(RoomList*);
-void ghostlyIsDifferent (HunterType *, EvidenceClassType);
\ No newline at end of file
+typedef struct TraceBuffer
+{
+  unsigned char data[TRACE_BUFFER_SIZE];
+  size_t used;
+  uint64_t baseTime;
+  uint64_t lastTime;
+  int writer;
+  struct TraceBuffer *next;
+} TraceBuffer;
+
+typedef struct Trace
+{
+  FILE *file;
+  long id;
+  pthread_mutex_t mutex; // only taken to register a buffer or write a chunk
+  TraceBuffer *buffers;
+  int writers;
+  double *clock;
+  struct timespec start;
+} Trace;
+
+int startTrace(BuildingType *, const char *, double *);
+void stopTrace(BuildingType *);
+void traceMove(BuildingType *, int, RoomType *);
+void traceDrop(BuildingType *, int, EvidenceType *);
+void traceStandard(BuildingType *, int, EvidenceType *);
+void traceCollect(BuildingType *, int);
+void traceShare(BuildingType *, int, int);
+void traceFear(BuildingType *, int, int);
+void traceExit(BuildingType *, int, ExitReason);
+
+/* stats.c */
+
+// every power of two above SKETCH_SUB is split into SKETCH_SUB buckets, a quantile is within 1 / SKETCH_SUB of the true value
+#define SKETCH_SUB_BITS 5
+#define SKETCH_SUB (1 << SKETCH_SUB_BITS)
+// enough buckets for values below 2^48
+#define SKETCH_BUCKETS ((48 - SKETCH_SUB_BITS + 1) * SKETCH_SUB)
+
+// count, mean and spread of a stream of values, by Welford's method
+typedef struct RunningStat
+{
+  long count;
+  double mean;
+  double m2; // sum of squared differences from the mean
+} RunningStat;
+
+// fixed size histogram of a stream of values that are at least 0, for their quantiles
+typedef struct QuantileSketch
+{
+  long count;
+  long buckets[SKETCH_BUCKETS];
+} QuantileSketch;
+
+void addRunningStat(RunningStat *, double);
+void mergeRunningStat(RunningStat *, RunningStat *);
+double runningStdDev(RunningStat *);
+void addSketch(QuantileSketch *, double);
+void mergeSketch(QuantileSketch *, QuantileSketch *);
+double sketchQuantile(QuantileSketch *, double);
+
+/* batch.c */
+
+// hunts a batch worker runs before it merges its statistics into the shared ones
+#define BATCH_FLUSH_RUNS 256
+// hunts between the rows -a writes, unless -A says otherwise
+#define BATCH_ROW_EVERY 10000
+
+// how every hunt of a run is set up
+typedef struct SimOptions
+{
+  BuildingMap *map;     // NULL uses the default house
+  const char *traceDir; // record every hunt into this directory, NULL records nothing
+  int hunters;          // hunters sent into the building
+  int ghosts;           // ghosts haunting it
+  bool ticks;           // run in lock step with runTicks instead of by wake up
+  SimConfig *config;    // parameters of the hunt, NULL uses the defaults
+  const BuildingLayout *layout; // shared by every hunt instead of building from map, NULL builds from map
+} SimOptions;
+
+typedef enum
+{
+  HUNTERS_WIN,
+  GHOST_WIN,
+  ALL_BORED
+} OutcomeType;
+
+#define NUM_OUTCOMES 3
+#define NUM_GHOST_TYPES 4
+
+typedef struct SimResult
+{
+  OutcomeType outcome;
+  long steps;
+  double simTime;
+  uint64_t seed;
+  // the ghosts of each GhostClassType, how many of them were identified and the evidence they left
+  int ghosts[NUM_GHOST_TYPES];
+  int identified[NUM_GHOST_TYPES];
+  int evidenceDropped[NUM_GHOST_TYPES];
+  // every reading left in the building and how many of them were ghostly
+  long readings;
+  long ghostlyReadings;
+  // the hunters of each EvidenceClassType of equipment, and how many of them left having found the ghost or scared
+  int equipment[NUM_EVIDENCE_TYPES];
+  int equipmentFound[NUM_EVIDENCE_TYPES];
+  int equipmentScared[NUM_EVIDENCE_TYPES];
+  // the fear of every hunter when it left, grown by runSimulation and kept between hunts run into the same result
+  int *fear;
+  int fearCount;
+  int fearCapacity;
+} SimResult;
+
+typedef struct BatchStats
+{
+  long runs;
+  long outcomes[NUM_OUTCOMES];
+  long long totalSteps;
+  double totalSimTime;
+  long ghostRuns[NUM_GHOST_TYPES];
+  long ghostHunterWins[NUM_GHOST_TYPES];
+  long ghostIdentified[NUM_GHOST_TYPES];
+  long long ghostEvidence[NUM_GHOST_TYPES];
+  long long readings;
+  long long ghostlyReadings;
+  RunningStat steps;   // of every hunt
+  RunningStat simTime; // of every hunt
+  RunningStat fear;    // of every hunter when it left
+  QuantileSketch *runLength;  // steps of every hunt, NULL unless initBatchStats was asked to keep sketches
+  QuantileSketch *fearAtExit; // fear of every hunter when it left, NULL along with runLength
+  long equipment[NUM_EVIDENCE_TYPES];
+  long equipmentFound[NUM_EVIDENCE_TYPES];
+  long equipmentScared[NUM_EVIDENCE_TYPES];
+} BatchStats;
+
+OutcomeType evaluateOutcome(BuildingType *);
+void initSimResult(SimResult *);
+void cleanupSimResult(SimResult *);
+void runSimulation(uint64_t, SimOptions *, SimResult *);
+void initBatchStats(BatchStats *, bool);
+void clearBatchStats(BatchStats *);
+void cleanupBatchStats(BatchStats *);
+void addSimResult(SimResult *, BatchStats *);
+void mergeBatchStats(BatchStats *, BatchStats *);
+void runBatch(long, int, uint64_t, SimOptions *, FILE *, long, BatchStats *);
+void printBatchStats(BatchStats *);
+void writeBatchHeader(FILE *);
+void writeBatchRow(FILE *, BatchStats *);
+
+/* sweep.c */
+
+#define SWEEP_DEFAULT_RUNS 100
+// a grid may not expand into more configurations than this
+#define SWEEP_MAX_CONFIGS 1000000
+
+// one parameter a sweep varies, over a list of values or, when sampling, a range
+typedef struct SweepAxis
+{
+  const ConfigKey *key;
+  double *values;
+  int count;
+  int capacity;
+  bool range; // values holds the bounds of a range, only allowed when sampling
+} SweepAxis;
+
+typedef struct Sweep
+{
+  SweepAxis *axes;
+  int axisCount;
+  SimConfig *configs; // every configuration to run, filled in by expandSweep
+  long configCount;
+} Sweep;
+
+int loadSweep(const char *, Sweep **);
+int expandSweep(Sweep *, SimConfig *, long, uint64_t);
+void runSweep(Sweep *, long, int, uint64_t, SimOptions *, FILE *);
+void cleanupSweep(Sweep *);
+
+/* scheduler.c */
+
+typedef enum
+{
+  HUNTER_ENTITY,
+  GHOST_ENTITY
+} EntityKind;
+
+typedef struct SimEvent
+{
+  double time;
+  long seq;
+  EntityKind kind;
+  void *entity;
+} SimEvent;
+
+// simulated seconds a tick of runTicks stands for, about the mean sleep of a hunter
+#define TICK_LENGTH 0.6
+
+// min-heap of entity wake ups ordered by virtual time
+typedef struct Scheduler
+{
+  SimEvent *heap;
+  int size;
+  int capacity;
+  double now;
+  long seq;
+  long steps;
+  bool *left;                    // entities that have left a hunt run by runTicks, by id, NULL when running by wake up
+  struct Checkpoint *checkpoint; // NULL unless the hunt is being checkpointed
+} Scheduler;
+
+void initScheduler(Scheduler **);
+void cleanupScheduler(Scheduler *);
+void scheduleEvent(Scheduler *, double, EntityKind, void *);
+bool popEvent(Scheduler *, SimEvent *);
+void scheduleBuilding(Scheduler *, BuildingType *);
+bool stepEntity(EntityKind, void *, double *);
+void runScheduler(Scheduler *);
+void runTicks(Scheduler *, BuildingType *);
+
+/* pool.c */
+
+// longest an idle worker sleeps before looking for work to steal again, in seconds
+#define POOL_IDLE 0.001
+// the speed a pool runs at by default, simulated seconds per second
+#define POOL_SPEED 1.0
+// a speed that runs the pool unpaced, as fast as the order of the wake ups allows
+#define POOL_UNLIMITED 0.0
+
+// one thread of a worker pool, with the entities that are ready to step and the ones sleeping until their wake up
+typedef struct PoolWorker
+{
+  struct WorkerPool *pool;
+  pthread_t thread;
+  pthread_mutex_t lock; // guards the ready deque, taken by the owner and by thieves
+  SimEvent *ready;      // circular deque, the owner works from the back and thieves steal from the front
+  int head;
+  int count;
+  int capacity;
+  Scheduler *timers;       // entities sleeping on this worker, keyed by the simulated second they wake at
+  _Atomic double nextWake; // the first wake up on timers, INFINITY if none, read by idle workers of an unpaced pool
+  RandState rng;           // picks who to steal from
+  long steps;
+  long steals;
+  double last; // simulated time of the last step it ran
+} PoolWorker;
+
+// a fixed set of threads that step every hunter and ghost of a building in real time
+typedef struct WorkerPool
+{
+  PoolWorker *workers;
+  int count;
+  atomic_int active;   // entities still in the hunt
+  double speed;        // simulated seconds per second, POOL_UNLIMITED to run unpaced
+  _Atomic double now;  // the simulated clock of an unpaced pool, a paced one reads the wall clock
+  atomic_long pending; // entities woken up and not yet put back to sleep, in a ready deque or being stepped
+  atomic_long wakeups; // counts every entity woken up, so a worker can tell pending did not go up and back down
+  struct timespec start;
+  double elapsed;   // seconds the hunt took, once run
+  double simulated; // simulated seconds the hunt lasted, once run
+} WorkerPool;
+
+void initWorkerPool(WorkerPool **, BuildingType *, int, double);
+void runWorkerPool(WorkerPool *);
+void cleanupWorkerPool(WorkerPool *);
+
+/* checkpoint.c */
+
+#define CHECKPOINT_MAGIC "GHCK"
+#define CHECKPOINT_VERSION 1
+// simulated seconds between checkpoints unless -e says otherwise
+#define CHECKPOINT_EVERY 30.0
+
+// a snapshot of a hunt in memory, grown as it is written
+typedef struct CheckpointBuffer
+{
+  unsigned char *data;
+  size_t used;
+  size_t capacity;
+} CheckpointBuffer;
+
+// the checkpoints of a running hunt, taken between steps into memory and written out by a background thread
+typedef struct Checkpoint
+{
+  BuildingType *building;
+  char *path;
+  double every;
+  double due;             // simulated time the next checkpoint is taken at
+  CheckpointBuffer snap;  // the snapshot being taken, only touched by the hunt
+  CheckpointBuffer ready; // the latest snapshot the writer has not picked up, a newer one replaces it
+  CheckpointBuffer out;   // the snapshot being written, only touched by the writer
+  bool hasReady;
+  bool stopping;          // the writer writes whatever is ready and exits
+  pthread_mutex_t mutex;  // guards ready, hasReady and stopping
+  pthread_cond_t wake;    // signalled when a snapshot is ready or the hunt stops
+  int *owner;      // scratch for the entity whose pool each piece of evidence is restored into
+  long ownerCount;
+  pthread_t writer;
+  bool started; // writer has been started and not yet joined, without it every checkpoint is written by the hunt
+  atomic_int failed; // checkpoints that could not be written
+  long taken;
+  long written; // only counted by the writer
+  double longestPause; // longest the hunt was held up taking a snapshot, in seconds
+} Checkpoint;
+
+int startCheckpoints(Scheduler *, BuildingType *, const char *, double);
+void checkpointHunt(Scheduler *);
+void stopCheckpoints(Scheduler *);
+int resumeCheckpoint(const char *, BuildingType **, Scheduler **);
+
+/* replay.c */
+
+// a keyframe is kept every REPLAY_KEYFRAME_INTERVAL events, a seek replays at most that many
+#ifndef REPLAY_KEYFRAME_INTERVAL
+#define REPLAY_KEYFRAME_INTERVAL 4096
+#endif
+
+// a position in a trace file read into memory, bad is set once a read runs past the end
+typedef struct TraceReader
+{
+  const unsigned char *data;
+  size_t size;
+  size_t pos;
+  bool bad;
+} TraceReader;
+
+// one recorded event, with the evidence it created, collected or shared resolved to its number in order of creation
+typedef struct ReplayEvent
+{
+  uint64_t time;
+  long evidence; // -1 if none, or if the event found nothing to collect or share
+  long seq;      // position in the file, keeps events of one writer in order when merging
+  int writer;
+  int entity;
+  int arg; // room of a move, hunter shared with, new fear or ExitReason
+  float value;
+  unsigned char op;
+  unsigned char type;
+} ReplayEvent;
+
+// everything a hunter has collected or read, in order
+typedef struct ReplayHistory
+{
+  long *items;
+  long count;
+  long capacity;
+} ReplayHistory;
+
+// the evidence ever dropped into one [type][isGhostly] bucket of a room, hunters always take from the front
+typedef struct ReplayBucket
+{
+  int room;
+  int type;
+  int ghostly;
+  long *items;
+  long count;
+  long capacity;
+} ReplayBucket;
+
+// the state of a hunt just before an event, as indexes into the histories and buckets
+typedef struct ReplayKeyframe
+{
+  long position;
+  long evidenceCount; // evidence created so far
+  int *rooms;         // room of every entity
+  int *fears;         // fear of every hunter
+  unsigned *known;    // known bits of every hunter
+  int *exits;         // 0 while an entity is in the hunt, otherwise its ExitReason + 1
+  long *lengths;      // length of every hunters history
+  int bucketCount;    // buckets used so far
+  long *heads;        // evidence collected from each bucket
+  long *tails;        // evidence dropped into each bucket
+  int *dropped;       // evidence dropped by every ghost
+} ReplayKeyframe;
+
+typedef struct Replay
+{
+  BuildingType *building;
+  HunterType **hunters;
+  int hunterCount;
+  int ghostCount;
+  int entityCount; // hunters then ghosts, as numbered in the trace
+  ReplayEvent *events;
+  long eventCount;
+  long position; // events applied to the building so far
+  long skipped;  // collects and shares that found nothing, only when threads recorded at the same microsecond
+  long *created; // event that created each piece of evidence
+  long evidenceCount;
+  EvidenceType **evidence; // the buildings copy of each piece of evidence created so far
+  ReplayHistory *histories;
+  ReplayBucket *buckets;
+  int bucketCount;
+  ReplayKeyframe *keyframes;
+  long keyframeCount;
+  int *exits; // 0 while an entity is in the hunt, otherwise its ExitReason + 1
+} Replay;
+
+int loadReplay(const char *, Replay **);
+void cleanupReplay(Replay *);
+bool stepReplay(Replay *);
+void seekReplay(Replay *, long);
+void printReplay(Replay *);
+
+/* metrics.c */
+
+// runtime metrics are only built with -DSIM_METRICS (make METRICS=1), otherwise every hook below compiles to nothing
+#define METRIC_BUCKETS 32
+
+// what an entity did with a step, the latency of the step is filed under it
+typedef enum
+{
+  ACTION_COLLECT,  // hunter took ghostly evidence from its room
+  ACTION_STANDARD, // hunter took a standard reading
+  ACTION_MOVE,     // hunter or ghost changed rooms
+  ACTION_SHARE,    // hunter shared with another hunter
+  ACTION_DROP,     // ghost left evidence
+  ACTION_IDLE,     // nothing happened, eg. a hunter alone in its room chose to share
+  ACTION_EXIT,     // the entity left the hunt
+  NUM_ACTIONS
+} MetricAction;
+
+typedef enum
+{
+  PHASE_SETUP, // building the building and its entities
+  PHASE_HUNT,
+  PHASE_REPORT, // working out and printing the outcome
+  NUM_PHASES
+} MetricPhase;
+
+// counters of one thread, only that thread writes them and they are merged once every thread is done
+typedef struct ThreadMetrics
+{
+  MetricAction action; // what the step being run has done so far
+  long actions[NUM_ACTIONS];
+  long long actionNs[NUM_ACTIONS];
+  long latency[NUM_ACTIONS][METRIC_BUCKETS]; // log2 histogram of step nanoseconds
+  long lockWaits[METRIC_BUCKETS];            // log2 histogram of nanoseconds waited on a room lock
+  long evidence[METRIC_BUCKETS];             // log2 histogram of the evidence in an entitys room after each step
+  double *occupancy;                         // seconds entities spent in each room, by room id
+  int rooms;
+  struct ThreadMetrics *next;
+} ThreadMetrics;
+
+#ifdef SIM_METRICS
+#define metricStart() metricClock()
+#define metricAction(action) recordAction(action)
+#define metricStep(started, room, active, delay) recordStep(started, room, active, delay)
+#define metricLockWait(ns) recordLockWait(ns)
+#define metricPhase(phase) recordPhase(phase)
+#define metricPrint() printMetrics()
+#else
+#define metricStart() 0
+#define metricAction(action) ((void)0)
+#define metricStep(started, room, active, delay) ((void)(started), (void)(room))
+#define metricLockWait(ns) ((void)0)
+#define metricPhase(phase) ((void)0)
+#define metricPrint() ((void)0)
+#endif
+
+uint64_t metricClock(void);
+void recordAction(MetricAction);
+void recordStep(uint64_t, RoomType *, bool, double);
+void recordLockWait(long);
+void recordPhase(MetricPhase);
+void printMetrics(void);
@@ -1,30 +1,80 @@
 #include "defs.h"
 
+/// @brief allocates an empty evidence pool, its first slab is only allocated when needed
+/// @param pool double pointer to which the new pool will be stored
+void initPool(EvidencePool **pool)
+{
+  *pool = calloc(1, sizeof(EvidencePool));
+  (*pool)->blocks = NULL;
+  (*pool)->next = NULL;
+  (*pool)->end = NULL;
+  (*pool)->freeNodes = NULL;
+}
+
+/// @brief frees every slab of a pool at once, along with every evidence and node ever taken from it
+/// @param pool the pool being free'd
+void cleanupPool(EvidencePool *pool)
+{
+  PoolBlock *temp;
+  while (pool->blocks != NULL)
+  {
+    temp = pool->blocks;
+    pool->blocks = pool->blocks->next;
+    free(temp);
+  }
+  free(pool);
+}
+
+/// @brief bump allocates zeroed memory from the current slab of a pool, starting a new slab when it runs out
+/// @param pool the pool being allocated from
+/// @param size the number of bytes needed, at most POOL_BLOCK_SIZE
+/// @return pointer to the memory, 8 byte aligned
+static void *poolAlloc(EvidencePool *pool, size_t size)
+{
+  size = (size + 7) & ~(size_t)7;
+  if (pool->next == NULL || (size_t)(pool->end - pool->next) < size)
+  {
+    PoolBlock *block = malloc(sizeof(PoolBlock) + POOL_BLOCK_SIZE);
+    block->next = pool->blocks;
+    pool->blocks = block;
+    pool->next = block->data;
+    pool->end = block->data + POOL_BLOCK_SIZE;
+  }
+  void *p = pool->next;
+  pool->next += size;
+  memset(p, 0, size);
+  return p;
+}
+
 /// @brief initalizes the EvidenceType with its class type and a value
+/// @param pool is the pool the evidence is allocated from
 /// @param type is the enumerated type defined by EvidenceClassType of the evidence
 /// @param value is the recorded value of the evidence
 /// @param e is the EvidenceType being initalized
-void initEvidence(EvidenceClassType type, float value, EvidenceType **e)
+void initEvidence(EvidencePool *pool, EvidenceClassType type, float value, EvidenceType **e)
 {
-  *e = calloc(1, sizeof(EvidenceType));
+  *e = poolAlloc(pool, sizeof(EvidenceType));
   (*e)->type = type;
   (*e)->value = value;
   (*e)->refrences = 0;
-}
-
-/// @brief frees the memory associated with an EvidenceType
-/// @param e is the EvidenceType being free'd
-void cleanupEvidence(EvidenceType *e)
-{
-  free(e);
+  (*e)->ghost = NULL;
 }
 
 /// @brief initializes a node containing some evidence and a refrence to other nodes. next and prev are defaulted to null
+/// @param pool is the pool the node is allocated from, recycled nodes are used first
 /// @param e is the EvidenceType data held by the node
 /// @param node is the node being initalized
-void initEvidenceNode(EvidenceType *e, EvidenceNode **node)
+void initEvidenceNode(EvidencePool *pool, EvidenceType *e, EvidenceNode **node)
 {
-  *node = calloc(1, sizeof(EvidenceNode));
+  if (pool->freeNodes != NULL)
+  {
+    *node = pool->freeNodes;
+    pool->freeNodes = pool->freeNodes->next;
+  }
+  else
+  {
+    *node = poolAlloc(pool, sizeof(EvidenceNode));
+  }
   (*node)->evidence = e;
   (*node)->next = NULL;
   (*node)->prev = NULL;
@@ -32,29 +82,24 @@ void initEvidenceNode(EvidenceType *e, EvidenceNode **node)
 }
 
 /// @brief copies the evidence data (assumed from another node) into a new node
+/// @param pool is the pool the node is allocated from
 /// @param e is the evidence data being coppied
 /// @param node is the node being coppied to
-void copyEvidence(EvidenceType *e, EvidenceNode **node)
+void copyEvidence(EvidencePool *pool, EvidenceType *e, EvidenceNode **node)
 {
-  initEvidenceNode(e, node);
+  initEvidenceNode(pool, e, node);
 }
 
-/// @brief frees the memory for a node (not the evidence)
+/// @brief hands a node (not the evidence) back to a pool to be reused
+/// @param pool is the pool the node is recycled into, it does not have to be the one it came from
 /// @param node is the node being free'd
-void cleanupEvidenceData(EvidenceNode *node)
+void cleanupEvidenceNode(EvidencePool *pool, EvidenceNode *node)
 {
   node->evidence->refrences--;
-  cleanupEvidence(node->evidence);
-  free(node);
+  node->next = pool->freeNodes;
+  pool->freeNodes = node;
 }
 
-/// @brief frees the memory for a node (not the evidence)
-/// @param node is the node being free'd
-void cleanupEvidenceNode(EvidenceNode *node)
-{
-  node->evidence->refrences--;
-  free(node);
-}
 /// @brief initalizes an evidence DLL list. the head and tail are defaulted to null, size is set to 0
 /// @param l is the list being initalized
 void initEvidenceList(EvidenceList **l)
@@ -64,32 +109,104 @@ void initEvidenceList(EvidenceList **l)
   (*l)->tail = NULL;
 }
 
-/// @brief frees the memory for a list and all of its nodes
+/// @brief frees the memory for a list, its nodes and evidence live in the entity pools and are released with them
 /// @param l is the list being free'd
 void cleanupEvidenceList(EvidenceList *l)
 {
-  EvidenceNode *temp;
-  while (l->head != NULL)
+  free(l);
+}
+
+/// @brief finds the segment and slot an index of the evidence log lives in, segment k holds LOG_FIRST_SEGMENT << k slots
+/// @param index the position in the log
+/// @param slot where the position inside the segment is stored
+/// @return the segment number
+static int logSegment(long index, long *slot)
+{
+  unsigned long scaled = (unsigned long)(index / LOG_FIRST_SEGMENT) + 1;
+  int seg = 63 - __builtin_clzl(scaled);
+  *slot = index - LOG_FIRST_SEGMENT * ((1L << seg) - 1);
+  return seg;
+}
+
+/// @brief allocates an empty evidence log, segments are only allocated when the first append reaches them
+/// @param log double pointer to which the new log will be stored
+void initEvidenceLog(EvidenceLog **log)
+{
+  *log = calloc(1, sizeof(EvidenceLog));
+  atomic_init(&(*log)->count, 0);
+  for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
   {
-    temp = l->head;
-    l->head = l->head->next;
-    cleanupEvidenceData(temp);
+    atomic_init(&(*log)->segments[i], NULL);
   }
-  free(l);
 }
 
-/// @brief frees the memory for a list and all of its nodes
-/// @param l is the list being free'd
-void cleanupEvidenceNodes(EvidenceList *l)
+/// @brief frees every segment of the log at once, the evidence itself lives in the entity pools
+/// @param log the log being free'd
+void cleanupEvidenceLog(EvidenceLog *log)
 {
-  EvidenceNode *temp;
-  while (l->head != NULL)
+  for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
   {
-    temp = l->head;
-    l->head = l->head->next;
-    cleanupEvidenceNode(temp);
+    free(atomic_load(&log->segments[i]));
   }
-  free(l);
+  free(log);
+}
+
+/// @brief appends evidence to the log without taking a lock, any number of threads may append at once
+/// @param log the log being appended to
+/// @param e the evidence being recorded
+/// @return the position the evidence was stored at
+long appendEvidenceLog(EvidenceLog *log, EvidenceType *e)
+{
+  // reserving the slot is the only contended step
+  long index = atomic_fetch_add_explicit(&log->count, 1, memory_order_relaxed);
+  long slot;
+  int seg = logSegment(index, &slot);
+
+  LogSlot *segment = atomic_load_explicit(&log->segments[seg], memory_order_acquire);
+  if (segment == NULL)
+  {
+    // whoever installs the segment first wins, everyone else throws theirs away
+    LogSlot *fresh = calloc((size_t)LOG_FIRST_SEGMENT << seg, sizeof(LogSlot));
+    if (atomic_compare_exchange_strong_explicit(&log->segments[seg], &segment, fresh, memory_order_acq_rel, memory_order_acquire))
+    {
+      segment = fresh;
+    }
+    else
+    {
+      free(fresh);
+    }
+  }
+  e->logIndex = (int)index;
+  atomic_store_explicit(&segment[slot], e, memory_order_release);
+  return index;
+}
+
+/// @brief the number of slots reserved in the log, some of the last ones may still be being written
+/// @param log the log being checked
+/// @return the number of appends so far
+long evidenceLogSize(EvidenceLog *log)
+{
+  return atomic_load_explicit(&log->count, memory_order_acquire);
+}
+
+/// @brief reads one entry of the log
+/// @param log the log being read
+/// @param index the position being read
+/// @return the evidence at that position, or NULL if it has not been published yet
+EvidenceType *evidenceLogAt(EvidenceLog *log, long index)
+{
+  if (index < 0 || index >= evidenceLogSize(log))
+  {
+    return NULL;
+  }
+  long slot;
+  int seg = logSegment(index, &slot);
+  LogSlot *segment = atomic_load_explicit(&log->segments[seg], memory_order_acquire);
+  if (segment == NULL)
+  {
+    return NULL;
+  }
+  return atomic_load_explicit(&segment[slot], memory_order_acquire);
 }
 
 /// @brief adds an EvidenceNode to the back of the EvidenceList
@@ -110,46 +227,45 @@ void addEvidence(EvidenceNode *node, EvidenceList *l)
   }
 }
 
-/// @brief deletes first node with matching type and value from the list
-/// @param type is the type of data recorded
-/// @param value is the magnitutde of the measurment
-/// @param l is the list being deleted fro
-/// @return 0 upon succesful delete, otherwise -1 if the value is not found
-int delEvidence(EvidenceNode *node, EvidenceList *l)
+/// @brief unlinks a node from the list it is in, in constant time, and recycles it
+/// @param node is the node being deleted, it must be in l
+/// @param l is the list being deleted from
+/// @param pool is the pool the removed node is recycled into
+/// @return 0 upon succesful delete, otherwise -1 if there is no node
+int delEvidence(EvidenceNode *node, EvidenceList *l, EvidencePool *pool)
 {
-  EvidenceNode *temp = l->head;
-  while (temp != NULL)
-  {
-    if (temp == node)
-    {
-      break;
-    }
-    temp = temp->next;
-  }
-  if (temp == NULL)
+  if (node == NULL)
   {
     return -1;
   }
 
-  if (temp->next != NULL && temp->prev != NULL)
+  if (node->prev != NULL)
   {
-    temp->next->prev = temp->prev;
-    temp->prev->next = temp->next;
+    node->prev->next = node->next;
   }
-  else if (temp->prev == NULL && temp->next != NULL)
+  else
   {
-    temp->next->prev = NULL;
-    l->head = temp->next;
+    l->head = node->next;
   }
-  else if (temp->next == NULL && temp->prev != NULL)
+  if (node->next != NULL)
   {
-    temp->prev->next = NULL;
-    l->tail = temp->prev;
+    node->next->prev = node->prev;
   }
-  cleanupEvidenceNode(temp);
+  else
+  {
+    l->tail = node->prev;
+  }
+  cleanupEvidenceNode(pool, node);
   return 0;
 }
 
+// the values each class of evidence reads when it is ghostly, inclusive, fingerprints are only ghostly at exactly 1
+static const double ghostlyRange[NUM_EVIDENCE_TYPES][2] = {
+    {4.7, 5.0},
+    {-10.0, 1.0},
+    {1.0, 1.0},
+    {65.0, 75.0}};
+
 /// @brief checks whether the evidencetype is ghostly or not
 /// @param evidence that is being checked
 /// @return returns a bool, true if the evidence is ghostly, false otherwise
@@ -158,57 +274,206 @@ bool isGhostly(EvidenceType *evidence)
 {
   int a = evidence->type;
   float val = evidence->value;
-  switch (a)
+  if (a < 0 || a >= NUM_EVIDENCE_TYPES)
   {
-  case 0:
-    return val >= 4.7 && val <= 5.0;
-  case 1:
-    return val >= -10.0 && val <= 1.0;
-  case 2:
-    return val == 1.0;
-  case 3:
-    return val >= 65.0 && val <= 75.0;
-  default:
     return false;
   }
+  return val >= ghostlyRange[a][0] && val <= ghostlyRange[a][1];
 }
 
-/// @brief shares ghostly evidence between two hunters
-/// @param c hunter that is sharing evidence
-/// @param r hunter that is getting evidence shared to them
+/// @brief the ghostly ranges as floats, rounded inwards so a float compare gives the same answer as the double compare of isGhostly,
+/// for 8 classes so a class index of up to 7 can pick from them directly, the classes past the real ones never match
+/// @param lo where the 8 lower bounds are stored
+/// @param hi where the 8 upper bounds are stored
+static void ghostlyBounds(float *lo, float *hi)
+{
+  for (int t = 0; t < 8; t++)
+  {
+    if (t >= NUM_EVIDENCE_TYPES)
+    {
+      lo[t] = INFINITY;
+      hi[t] = -INFINITY;
+      continue;
+    }
+    lo[t] = (float)ghostlyRange[t][0];
+    if (lo[t] < ghostlyRange[t][0])
+    {
+      lo[t] = nextafterf(lo[t], INFINITY);
+    }
+    hi[t] = (float)ghostlyRange[t][1];
+    if (hi[t] > ghostlyRange[t][1])
+    {
+      hi[t] = nextafterf(hi[t], -INFINITY);
+    }
+  }
+}
 
-void shareGhostlyEvidence(HunterType *c, HunterType *r)
+/// @brief classifies readings one at a time, for machines without a vector unit and for the tail of the vector versions
+/// @return the number of readings classified, always n
+static long classifyScalar(const unsigned char *types, const float *values, long from, long n, uint64_t *mask, const float *lo, const float *hi)
 {
-  EvidenceNode *temp = c->evidence->head;
-  EvidenceNode *node = NULL;
-  while (temp != NULL)
+  for (long i = from; i < n; i++)
+  {
+    int t = types[i] < 8 ? types[i] : 7;
+    uint64_t ghostly = values[i] >= lo[t] && values[i] <= hi[t];
+    mask[i >> 6] |= ghostly << (i & 63);
+  }
+  return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/// @brief classifies readings 8 at a time, each lane picks the bounds of its class from a register with a permute
+/// @return the number of readings classified, a multiple of 64, the rest are left for classifyScalar
+__attribute__((target("avx2"))) static long classifyAvx2(const unsigned char *types, const float *values, long n, uint64_t *mask, const float *lo, const float *hi)
+{
+  __m256 low = _mm256_loadu_ps(lo);
+  __m256 high = _mm256_loadu_ps(hi);
+  __m256i last = _mm256_set1_epi32(7);
+  long i = 0;
+  for (; i + 64 <= n; i += 64)
   {
-    if (isGhostly(temp->evidence))
+    uint64_t word = 0;
+    for (int j = 0; j < 64; j += 8)
     {
-      copyEvidence(temp->evidence, &node);
-      addEvidence(node, r->evidence);
-      printf("HUNTER: %s HAS SHARED %s GHOSTLY EVIDENCE WITH %s\n", c->name, evidenceEnumToStr(node->evidence->type), r->name);
-      ghostlyIsDifferent(r, node->evidence->type);
-      break;
+      __m256i t = _mm256_min_epu32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(types + i + j))), last);
+      __m256 v = _mm256_loadu_ps(values + i + j);
+      __m256 in = _mm256_and_ps(_mm256_cmp_ps(v, _mm256_permutevar8x32_ps(low, t), _CMP_GE_OQ),
+                                _mm256_cmp_ps(v, _mm256_permutevar8x32_ps(high, t), _CMP_LE_OQ));
+      word |= (uint64_t)_mm256_movemask_ps(in) << j;
     }
-    temp = temp->next;
+    mask[i >> 6] = word;
   }
+  return i;
 }
-void ghostlyIsDifferent(HunterType *hunter, EvidenceClassType evi)
+
+/// @brief classifies readings 4 at a time, SSE2 has no permute by lane so every class is compared and masked by whether the lane is of it
+/// @return the number of readings classified, a multiple of 64, the rest are left for classifyScalar
+static long classifySse2(const unsigned char *types, const float *values, long n, uint64_t *mask, const float *lo, const float *hi)
 {
-  bool doesnthave = true; 
-  for (int i = 0; i < MAX_HUNTERS; i++) {
-   if (hunter->typesCollected[i] == evi) {
-    doesnthave = false; 
-    break; 
-   }
+  __m128 low[NUM_EVIDENCE_TYPES], high[NUM_EVIDENCE_TYPES];
+  __m128i kind[NUM_EVIDENCE_TYPES];
+  for (int t = 0; t < NUM_EVIDENCE_TYPES; t++)
+  {
+    low[t] = _mm_set1_ps(lo[t]);
+    high[t] = _mm_set1_ps(hi[t]);
+    kind[t] = _mm_set1_epi32(t);
   }
-  if (doesnthave) {
-    hunter->typesCollected[hunter->hasDifferentGhostly -1] = (int)evi;
-    hunter->hasDifferentGhostly++;
+  __m128i zero = _mm_setzero_si128();
+  long i = 0;
+  for (; i + 64 <= n; i += 64)
+  {
+    uint64_t word = 0;
+    for (int j = 0; j < 64; j += 4)
+    {
+      int packed;
+      memcpy(&packed, types + i + j, sizeof(packed));
+      __m128i t = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+      __m128 v = _mm_loadu_ps(values + i + j);
+      __m128 in = _mm_setzero_ps();
+      for (int k = 0; k < NUM_EVIDENCE_TYPES; k++)
+      {
+        __m128 ofKind = _mm_castsi128_ps(_mm_cmpeq_epi32(t, kind[k]));
+        __m128 inRange = _mm_and_ps(_mm_cmpge_ps(v, low[k]), _mm_cmple_ps(v, high[k]));
+        in = _mm_or_ps(in, _mm_and_ps(ofKind, inRange));
+      }
+      word |= (uint64_t)_mm_movemask_ps(in) << j;
+    }
+    mask[i >> 6] = word;
+  }
+  return i;
+}
+
+// batch workers classify at once, so which kernel runs is decided once, by whichever of them gets there first
+static pthread_once_t cpuDetected = PTHREAD_ONCE_INIT;
+static bool hasAvx2 = false;
+
+/// @brief checks once whether the processor has AVX2, for classifyGhostly
+static void detectCpu(void)
+{
+  __builtin_cpu_init();
+  hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+}
+#endif
+
+/// @brief classifies a run of readings at once, with AVX2 or SSE2 compares where the processor has them
+/// @param types the EvidenceClassType of every reading, one byte each
+/// @param values the value of every reading
+/// @param n the number of readings
+/// @param mask where bit i of word i / 64 is set if reading i is ghostly, (n + 63) / 64 words long, every word is written
+/// @return the number of ghostly readings
+long classifyGhostly(const unsigned char *types, const float *values, long n, uint64_t *mask)
+{
+  float lo[8], hi[8];
+  ghostlyBounds(lo, hi);
+  long words = (n + 63) / 64;
+  memset(mask, 0, words * sizeof(uint64_t));
+
+  long done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  pthread_once(&cpuDetected, detectCpu);
+  done = hasAvx2 ? classifyAvx2(types, values, n, mask, lo, hi) : classifySse2(types, values, n, mask, lo, hi);
+#endif
+  classifyScalar(types, values, done, n, mask, lo, hi);
+
+  long ghostly = 0;
+  for (long i = 0; i < words; i++)
+  {
+    ghostly += __builtin_popcountll(mask[i]);
   }
+  return ghostly;
 }
 
+/// @brief counts the ghostly readings among every piece of evidence logged in a building, copying them into runs of plain arrays for classifyGhostly
+/// @param log the evidence log, no entity may still be appending to it
+/// @return the number of ghostly readings
+long countGhostlyLog(EvidenceLog *log)
+{
+  unsigned char types[GHOSTLY_RUN];
+  float values[GHOSTLY_RUN];
+  uint64_t mask[GHOSTLY_RUN / 64];
+  long size = evidenceLogSize(log);
+  long ghostly = 0;
+  for (long start = 0; start < size; start += GHOSTLY_RUN)
+  {
+    long n = size - start < GHOSTLY_RUN ? size - start : GHOSTLY_RUN;
+    for (long i = 0; i < n; i++)
+    {
+      EvidenceType *e = evidenceLogAt(log, start + i);
+      types[i] = (unsigned char)e->type;
+      values[i] = e->value;
+    }
+    ghostly += classifyGhostly(types, values, n, mask);
+  }
+  return ghostly;
+}
+
+/// @brief shares ghostly evidence between two hunters, the hunter told learns every kind the sharer knows of in one atomic OR, so it needs no lock and copies nothing
+/// @param c hunter that is sharing evidence
+/// @param r hunter that is getting evidence shared to them
+
+void shareGhostlyEvidence(HunterType *c, HunterType *r)
+{
+  EntityTable *t = &c->building->table;
+  unsigned known = atomic_load_explicit(&t->known[c->id], memory_order_relaxed);
+  unsigned had = atomic_fetch_or_explicit(&t->known[r->id], known, memory_order_relaxed);
+  traceShare(c->building, c->id, r->id);
+  if ((known & ~had) != 0)
+  {
+    logEvent(LOG_INFO, "HUNTER: %s HAS SHARED %d NEW KINDS OF GHOSTLY EVIDENCE WITH %s\n", c->name, __builtin_popcount(known & ~had), r->name);
+  }
+}
+
+/// @brief records that a hunter knows of a kind of ghostly evidence, on its own bits and on the bits of the team
+/// @param hunter the hunter that collected it
+/// @param evi the kind of evidence
+void learnGhostly(HunterType *hunter, EvidenceClassType evi)
+{
+  EntityTable *t = &hunter->building->table;
+  atomic_fetch_or_explicit(&t->known[hunter->id], 1u << evi, memory_order_relaxed);
+  atomic_fetch_or_explicit(&t->team, 1u << evi, memory_order_relaxed);
+}
 
 /// @brief prints the data (type and value) of the evidence node
 /// @param e is the evidence node being printed
@@ -261,4 +526,4 @@ const char *evidenceEnumToStr(EvidenceClassType t)
   default:
     return "THIS BAD";
   }
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,29 +1,153 @@
 #include "defs.h"
 
+/*
+  Function:  splitMix
+  Purpose:   advances a splitmix64 counter and returns its next
+             output, used to expand one seed into a full state
+   in/out:   the counter being advanced
+   return:   the next 64 bit output
+*/
+static uint64_t splitMix(uint64_t *x)
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+/*
+  Function:  seedRand
+  Purpose:   seeds a xoshiro256** generator, the same seed always
+             gives the same sequence
+      out:   the generator being seeded
+       in:   the seed
+*/
+void seedRand(RandState *r, uint64_t seed)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    r->s[i] = splitMix(&seed);
+  }
+}
+
+/*
+  Function:  nextRand
+  Purpose:   returns the next output of a xoshiro256** generator
+   in/out:   the generator being advanced
+   return:   a uniformly distributed 64 bit integer
+*/
+uint64_t nextRand(RandState *r)
+{
+  uint64_t *s = r->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+/*
+  Function:  splitRand
+  Purpose:   hands a child the parents current stream and jumps the
+             parent 2^128 steps ahead, so every child split from the
+             same parent gets its own non-overlapping stream
+   in/out:   the parent generator
+      out:   the child generator
+*/
+void splitRand(RandState *parent, RandState *child)
+{
+  static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                  0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+  uint64_t s[4] = {0, 0, 0, 0};
+
+  *child = *parent;
+  for (int i = 0; i < 4; i++)
+  {
+    for (int b = 0; b < 64; b++)
+    {
+      if (JUMP[i] & (1ULL << b))
+      {
+        for (int j = 0; j < 4; j++)
+        {
+          s[j] ^= parent->s[j];
+        }
+      }
+      nextRand(parent);
+    }
+  }
+  for (int j = 0; j < 4; j++)
+  {
+    parent->s[j] = s[j];
+  }
+}
+
 /*
   Function:  randInt
   Purpose:   returns a pseudo randomly generated number,
              in the range min to (max - 1), inclusively
+   in/out:   the generator being drawn from
        in:   upper end of the range of the generated number
    return:   randomly generated integer in the range [min, max-1)
 */
-// WONT LET ME USE THESE FUNCTIONS?
-int randInt(int min, int max)
+int randInt(RandState *r, int min, int max)
 {
-  return rand() % (max - min) + min;
+  // multiply the top 32 bits into the range instead of using modulo
+  uint64_t x = nextRand(r) >> 32;
+  return (int)((x * (uint64_t)(max - min)) >> 32) + min;
 }
 
 /*
   Function:  randFloat
   Purpose:   returns a pseudo randomly generated number,
-             in the range min to max, inclusively
+             in the range min to max
+   in/out:   the generator being drawn from
        in:   upper end of the range of the generated number
-   return:   randomly generated integer in the range [0, max-1)
+   return:   randomly generated float in the range [a, b)
 */
-float randFloat(float a, float b)
+float randFloat(RandState *r, float a, float b)
 {
-  // Get a percentage between rand() and the maximum
-  float random = ((float)rand()) / (float)RAND_MAX;
+  // the top 24 bits give every float in [0, 1) an equal chance
+  float random = (float)(nextRand(r) >> 40) * 0x1.0p-24f;
   // Scale it to the range we want, and shift it
   return random * (b - a) + a;
-}
\ No newline at end of file
+}
+
+/*
+  Function:  pickOdds
+  Purpose:   picks one of a number of choices, each with a chance
+             proportional to its weight, with every weight 1 it
+             draws exactly what randInt(0, n) would
+   in/out:   the generator being drawn from
+       in:   the weight of every choice, at least one above 0
+       in:   the number of choices
+   return:   the index of the choice picked
+*/
+int pickOdds(RandState *r, const int *odds, int n)
+{
+  int total = 0;
+  for (int i = 0; i < n; i++)
+  {
+    total += odds[i];
+  }
+  int pick = randInt(r, 0, total);
+  for (int i = 0; i < n - 1; i++)
+  {
+    if (pick < odds[i])
+    {
+      return i;
+    }
+    pick -= odds[i];
+  }
+  return n - 1;
+}
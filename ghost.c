@@ -1,51 +1,98 @@
 #include "defs.h"
 
 
-/// @brief initializes a ghost with given and default paraemters, uses existing functions to help  
-/// @param b pointer to the building of the ghost 
+/// @brief initializes a ghost with given and default paraemters and adds it to the ghosts of the building, uses existing functions to help  
+/// @param b pointer to the building of the ghost, every hunter must already be in it so ghost ids follow theirs
 /// @param g double pointer to store the new initialized ghost 
 void initGhost(BuildingType *b, GhostType **ghost)
 {
 
   (*ghost) = calloc(1, sizeof(GhostType));
-  (*ghost)->boredom = BOREDOM_MAX;
-  (*ghost)->type = randInt(0, 4);
   (*ghost)->building = b;
-  b->ghost = (*ghost);
+  if (b->ghostCount == b->ghostCapacity)
+  {
+    b->ghostCapacity = b->ghostCapacity == 0 ? DEFAULT_GHOSTS : b->ghostCapacity * 2;
+    b->ghosts = realloc(b->ghosts, b->ghostCapacity * sizeof(GhostType *));
+  }
+  (*ghost)->index = b->ghostCount;
+  b->ghosts[b->ghostCount++] = (*ghost);
+  (*ghost)->id = b->noteBook->count + (*ghost)->index;
+  (*ghost)->identified = false;
+  splitRand(&b->rng, &(*ghost)->rng);
+  (*ghost)->type = randInt(&(*ghost)->rng, 0, 4);
+  initPool(&(*ghost)->pool);
 
-  RoomType *c = findRandRoom((*ghost)->building->rooms);
-  if (c == b->rooms->head->room)
+  RoomType *c = b->roomIndex[randInt(&(*ghost)->rng, 0, b->roomCount)];
+  // never start in the room the hunters spawn in
+  if (c == b->spawn)
   {
-    c = b->rooms->tail->room;
+    c = b->roomIndex[c->id == b->roomCount - 1 ? 0 : b->roomCount - 1];
   }
   (*ghost)->room = c;
+  addEntity(b, (*ghost)->id, c);
+  atomic_fetch_add_explicit(&c->ghosts, 1, memory_order_relaxed);
 }
 
-/// @brief cleans up the ghost by freeing it  
+/// @brief cleans up the ghost by freeing it along with all the evidence it has dropped
 /// @param g pointer to ghost to free
 void cleanupGhost(GhostType *ghost)
 {
+  cleanupPool(ghost->pool);
   free(ghost);
 }
 
-/// @brief similar to updateHunterRoom, updates past and curr room pointers with the ghost  
+/// @brief similar to updateHunterRoom, moves the ghost and updates how many ghosts the past and curr rooms have
 /// @param g pointer to ghost to update all conditions
 void updateGhostRoom(GhostType *g, RoomType *r)
 {
-  g->room->ghost = NULL;
+  atomic_fetch_sub_explicit(&g->room->ghosts, 1, memory_order_relaxed);
   g->room = r;
+  g->building->table.room[g->id] = r;
   if (g->room != NULL)
   {
-    g->room->ghost = g;
+    atomic_fetch_add_explicit(&g->room->ghosts, 1, memory_order_relaxed);
+    traceMove(g->building, g->id, r);
+  }
+}
+
+/// @brief works out which ghosts were identified once a hunt is over, a ghost is identified when a hunter that knows of enough different ghostly evidence holds ghostly evidence it left
+/// @param b the building, no entity may still be running
+/// @return the number of ghosts identified
+int identifyGhosts(BuildingType *b)
+{
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    b->ghosts[i]->identified = false;
+  }
+  for (int i = 0; i < b->noteBook->count; i++)
+  {
+    HunterType *h = b->noteBook->hunters[i];
+    if (knownKinds(b, h->id) < b->config.foundKinds)
+    {
+      continue;
+    }
+    for (EvidenceNode *n = h->evidence->head; n != NULL; n = n->next)
+    {
+      if (n->evidence->ghost != NULL && isGhostly(n->evidence))
+      {
+        n->evidence->ghost->identified = true;
+      }
+    }
+  }
+  int identified = 0;
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    identified += b->ghosts[i]->identified;
   }
+  return identified;
 }
 
 /// @brief generates a ghostly evidence depending on the ghost type, and adds it to the rooms collection 
 /// @param g pointer to ghost that will drop the evidence 
 void createEvidence(GhostType *g)
 {
-  GhostClassType type;
-  int rand = randInt(0, 3);
+  EvidenceClassType type;
+  int rand = randInt(&g->rng, 0, 3);
 
   switch (g->type)
   {
@@ -60,10 +107,11 @@ void createEvidence(GhostType *g)
       type = TEMPERATURE;
       break;
 
-    case 2:
+    default:
       type = FINGERPRINTS;
       break;
     }
+    break;
 
   case BANSHEE:
     switch (rand)
@@ -76,10 +124,11 @@ void createEvidence(GhostType *g)
       type = TEMPERATURE;
       break;
 
-    case 2:
+    default:
       type = SOUND;
       break;
     }
+    break;
   case BULLIES:
     switch (rand)
     {
@@ -91,10 +140,11 @@ void createEvidence(GhostType *g)
       type = FINGERPRINTS;
       break;
 
-    case 2:
+    default:
       type = SOUND;
       break;
     }
+    break;
   case PHANTOM:
     switch (rand)
     {
@@ -106,123 +156,140 @@ void createEvidence(GhostType *g)
       type = FINGERPRINTS;
       break;
 
-    case 2:
+    default:
       type = SOUND;
       break;
     }
+    break;
+  default:
+    // every ghost is one of the types above, this only keeps type set on every path
+    type = EMF;
+    break;
   }
 
   float val = 0;
   switch (g->type)
   {
   case POLTERGEIST:
-    val = randFloat(0, 5.0);
+    val = randFloat(&g->rng, 0, 5.0);
     break;
   case BANSHEE:
-    val = randFloat(-10.0, 27.0);
+    val = randFloat(&g->rng, -10.0, 27.0);
     break;
   case BULLIES:
-    val = (float)randInt(0, 2);
+    val = (float)randInt(&g->rng, 0, 2);
+    break;
   case PHANTOM:
-    val = randFloat(40.0, 75.0);
+    val = randFloat(&g->rng, 40.0, 75.0);
     break;
   }
 
+  dropEvidence(g, type, val);
+}
+
+/// @brief leaves a piece of evidence in the ghosts room, also used to redo a recorded drop when replaying a trace
+/// @param g pointer to ghost that is dropping the evidence
+/// @param type the type of evidence
+/// @param val the value of the evidence
+/// @return the evidence that was dropped
+EvidenceType *dropEvidence(GhostType *g, EvidenceClassType type, float val)
+{
   // init a evidence
   EvidenceType *e = NULL;
   EvidenceNode *node = NULL;
-  initEvidence(type, val, &e);
-  initEvidenceNode(e, &node);
-  addEvidence(node, g->room->evidence);
-  initEvidenceNode(e, &node);
-  addEvidence(node, g->building->evidence);
-  printf("THE GHOST HAS LEFT: %s\n", evidenceEnumToStr(node->evidence->type));
+  initEvidence(g->pool, type, val, &e);
+  e->ghost = g;
+  initEvidenceNode(g->pool, e, &node);
+  addRoomEvidence(g->room, node);
+  appendEvidenceLog(g->building->evidence, e);
+  traceDrop(g->building, g->id, e);
+  g->evidenceDropped++;
+  logEvent(LOG_INFO, "THE GHOST HAS LEFT: %s\n", evidenceEnumToStr(e->type));
+  return e;
 }
 
-/// @brief function in which the ghost thread wil be ran, constantly updating the hunter based on randomized conditions posibily moving rooms, dropping evidence, or doing nothing and updating its exit conditions     
-/// @param ghostArg void pointer, will by typecasted to a ghost argument 
-void *updateGhost(void *ghostArg)
+/// @brief performs one iteration of the ghosts behaviour, posibily moving rooms, dropping evidence, or doing nothing and updating its exit conditions
+/// @param ghost the ghost being stepped
+/// @return returns true if the ghost is still haunting, false once it has gotten bored
+bool stepGhost(GhostType *ghost)
 {
-  bool foundHunterAgain = false; 
-  GhostType *ghost = (GhostType *)ghostArg;
-  while (ghost->boredom > 0)
+  int *boredom = &ghost->building->table.boredom[ghost->id];
+  if (*boredom <= 0)
   {
-    if (hasHunter(ghost->room))
-    {
-      
-      if (foundHunterAgain) {
-        ghost->boredom = BOREDOM_MAX;
-        foundHunterAgain = false; 
-      }
-      int a = randInt(0, 2);
-      if (a == 0)
-      {
-        RoomType *curr = ghost->room;
-        if (!sem_trywait(&(curr->mutex)))
-        {
-          createEvidence(ghost);
-          sem_post(&(curr->mutex));
-        }
-      }
+    logEvent(LOG_INFO, "THE GHOST HAS GOT BORED\n");
+    traceExit(ghost->building, ghost->id, EXIT_BORED);
+    return false;
+  }
+  // with a hunter in the room the ghost draws from its haunt odds instead
+  const int *odds = ghost->building->config.ghostOdds;
+  if (hasHunter(ghost->room))
+  {
+    if (ghost->foundHunterAgain) {
+      *boredom = ghost->building->config.boredomMax;
+      ghost->foundHunterAgain = false; 
     }
-    // if the ghost-> room doesn't have hunters do one of the following
-    // (move to an adjacent room, make new evidence, or nothing)
-    else
-    {
-      int b = randInt(0, 3);
+    odds = ghost->building->config.hauntOdds;
+  }
 
-      switch (b)
-      {
-      case 0:
-        RoomType *prev = ghost->room;
-        RoomType *next = NULL;
-        if (!sem_trywait(&(prev->mutex)))
-        {
-          while (true)
-          {
-            next = findRandRoom(ghost->room->rooms);
-            if (!sem_trywait(&(next->mutex)))
-            {
-              updateGhostRoom(ghost, next);
-              if (hasHunter(next)) {
-                foundHunterAgain = true; 
-              }
-              printf("THE GHOST HAS MOVED TO: %s\n", next->name);
-              break;
-            }
-          }
-          sem_post(&(prev->mutex));
-          sem_post(&(next->mutex));
-        }
-
-        break;
-
-      case 1:
-        printf("\n");
-        RoomType *curr = ghost->room;
-        if (!sem_trywait(&(curr->mutex)))
-        {
-          createEvidence(ghost);
-          sem_post(&(curr->mutex));
-        }
-
-        break;
-
-      case 2:
-        // do nothing
-        break;
-      }
+  switch (pickOdds(&ghost->rng, odds, NUM_GHOST_ACTIONS))
+  {
+  case GHOST_MOVE:
+    RoomType *prev = ghost->room;
+    RoomType *next = findRandRoom(ghost->building, prev, &ghost->rng);
+    if (next == NULL)
+    {
+      // a room with no connections, stay put
+      break;
     }
-    ghost->boredom--;
-    sleep(randFloat(0.5, 1));
+    lockRooms(prev, next);
+    updateGhostRoom(ghost, next);
+    if (hasHunter(next)) {
+      ghost->foundHunterAgain = true; 
+    }
+    unlockRooms(prev, next);
+    metricAction(ACTION_MOVE);
+    logEvent(LOG_INFO, "THE GHOST HAS MOVED TO: %s\n", next->name);
+    break;
+
+  case GHOST_DROP:
+    logEvent(LOG_DEBUG, "\n");
+    lockRoom(ghost->room);
+    createEvidence(ghost);
+    unlockRoom(ghost->room);
+    metricAction(ACTION_DROP);
+    break;
+
+  case GHOST_IDLE:
+    // do nothing
+    break;
   }
-  printf("THE GHOST HAS GOT BORED\n");
-  return NULL;
+  (*boredom)--;
+  return true;
 }
 
 /// @brief prints the ghost to the screen  
 /// @param g pointer to ghost the ghost that will be printed  
 void printGhost(GhostType *ghost)
 {
-  printf("Ghost - room: %s\n", ghost->room->name);
-}
\ No newline at end of file
+  printf("Ghost - %s, room: %s, %s\n", ghostEnumToStr(ghost->type), ghost->room->name, ghost->identified ? "IDENTIFIED" : "NOT IDENTIFIED");
+}
+
+/// @brief matches the ghost class type enum to the string it represents
+/// @param t is the enumerated ghost class
+/// @return the appropriate string it maps to
+const char *ghostEnumToStr(GhostClassType t)
+{
+  switch (t)
+  {
+  case POLTERGEIST:
+    return "POLTERGEIST";
+  case BANSHEE:
+    return "BANSHEE";
+  case BULLIES:
+    return "BULLIES";
+  case PHANTOM:
+    return "PHANTOM";
+  default:
+    return "THIS BAD";
+  }
+}
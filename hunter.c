@@ -15,24 +15,26 @@ void initHunter(char *name, EvidenceClassType type, BuildingType *b, HunterType
   strcpy((*h)->name, name);
   (*h)->equipment = type;
   (*h)->building = b;
-  (*h)->room = (*h)->building->rooms->head->room;
-  (*h)->fear = 0;
-  (*h)->boredom = BOREDOM_MAX;
-  (*h)->hasDifferentGhostly = 1;
+  (*h)->room = (*h)->building->spawn;
+  (*h)->id = b->noteBook->count;
+  addEntity(b, (*h)->id, (*h)->room);
+  splitRand(&b->rng, &(*h)->rng);
 
   EvidenceList *hunterList = NULL;
   initEvidenceList(&hunterList);
   (*h)->evidence = hunterList;
+  initPool(&(*h)->pool);
   addHunter((*h), b->noteBook);
-  addHunter((*h), (*h)->room->hunters);
+  (*h)->roomSlot = addHunter((*h), &(*h)->room->hunters);
 }
 
-/// @brief cleans up the hunter by using an existing function to clean up its evidence (only part thats independent to it), and then freeing it 
+/// @brief cleans up the hunter by freeing its evidence list and its pool, which releases every evidence and node it allocated in one go, and then freeing it 
 /// @param h hunter that is being cleaned 
 
 void cleanupHunter(HunterType *h)
 {
-  cleanupEvidenceNodes(h->evidence);
+  cleanupEvidenceList(h->evidence);
+  cleanupPool(h->pool);
   free(h);
 }
 
@@ -42,175 +44,219 @@ void cleanupHunter(HunterType *h)
 
 void cleanupHunters(HunterNotebook *n)
 {
-  for (int i = 0; i < MAX_HUNTERS; i++)
+  for (int i = 0; i < n->count; i++)
   {
     cleanupHunter(n->hunters[i]);
   }
-  free(n);
+  cleanupNotebook(n);
 }
 
-/// @brief initialize the hunter notebook  
+/// @brief initialize the hunter notebook, its roster is only allocated once the first hunter is added so empty rooms cost nothing
 /// @param n pointer to the hunter notebook to be intialized and stored in 
 
 void initNotebook(HunterNotebook **n)
 {
   *n = calloc(1, sizeof(HunterNotebook));
+  (*n)->hunters = NULL;
   (*n)->count = 0;
+  (*n)->capacity = 0;
+  atomic_init(&(*n)->present, 0);
 }
 
-/// @brief cleans up the hunter notebook, by freeing the notebook itself   
+/// @brief cleans up the hunter notebook, by freeing its roster and the notebook itself   
 /// @param n pointer to the hunter notebook to be cleaned  
 
 void cleanupNotebook(HunterNotebook *n)
 {
+  free(n->hunters);
   free(n);
 }
 
-/// @brief adds a hunter to the given hunter notebook, increments the notebook count  
+/// @brief adds a hunter to the end of the given hunter notebook, doubling the roster when it is full, increments the notebook count  
 /// @param hunter pointer to the hunter to be added
 /// @param notebook pointer to the hunter notebook to which the hunter is going to be added   
+/// @return the position the hunter was added at
 
-void addHunter(HunterType *hunter, HunterNotebook *notebook)
+int addHunter(HunterType *hunter, HunterNotebook *notebook)
 {
+  if (notebook->count == notebook->capacity)
+  {
+    notebook->capacity = notebook->capacity == 0 ? NOTEBOOK_START : notebook->capacity * 2;
+    notebook->hunters = realloc(notebook->hunters, notebook->capacity * sizeof(HunterType *));
+  }
   notebook->hunters[notebook->count] = hunter;
-  notebook->count++;
+  atomic_store_explicit(&notebook->present, notebook->count + 1, memory_order_relaxed);
+  return notebook->count++;
 }
 
 
-/// @brief removes a hunter from the given hunter notebook, and shifts the rest of the notebook, decrements the notebook count     
-/// @param hunter pointer to the hunter to be removed
-/// @param notebook pointer to the hunter notebook to which the hunter is going to removed from 
+/// @brief removes a hunter from the notebook of a room in constant time, by moving the last hunter into its place, decrements the notebook count     
+/// @param hunter pointer to the hunter to be removed, its roomSlot says where it is
+/// @param notebook pointer to the room notebook to which the hunter is going to removed from 
 void removeHunter(HunterType *hunter, HunterNotebook *notebook)
 {
+  int i = hunter->roomSlot;
+  if (i >= notebook->count || notebook->hunters[i] != hunter)
+  {
+    return;
+  }
 
-  int i = 0;
+  HunterType *last = notebook->hunters[--notebook->count];
+  atomic_store_explicit(&notebook->present, notebook->count, memory_order_relaxed);
+  notebook->hunters[i] = last;
+  last->roomSlot = i;
+}
 
-  // search for id
-  while (notebook->hunters[i] != hunter)
+/// @brief performs one iteration of the hunters behaviour, posibily moving rooms, collecting/sharing evidence, dropping evidence, or doing nothing and updating its exit conditions
+/// @param hunter the hunter being stepped
+/// @return returns true if the hunter is still hunting, false once it has left (bored, scared or done)
+bool stepHunter(HunterType *hunter)
+{
+  EntityTable *t = &hunter->building->table;
+  t->ghostsHere[hunter->id] = atomic_load_explicit(&hunter->room->ghosts, memory_order_relaxed);
+  t->found[hunter->id] = knownKinds(hunter->building, hunter->id);
+  checkHunters(t, &hunter->building->config, hunter->id, hunter->id + 1);
+  if (!applyCheck(hunter))
   {
-    i++;
-    if (i >= MAX_HUNTERS)
-    {
-      return;
-    }
+    return false;
+  }
+  actHunter(hunter);
+  return true;
+}
+
+/// @brief the loop of checkHunters, its arrays are parameters so the compiler knows they never overlap and vectorizes it without a runtime check
+static void checkRange(int *restrict fear, int *restrict boredom, const int *restrict found, const int *restrict ghosts, unsigned char *restrict check, const SimConfig *c, int from, int to)
+{
+  // read once, the compiler can not tell the config apart from the arrays being written
+  const int fearRate = c->fearRate, maxFear = c->maxFear, boredomMax = c->boredomMax, foundKinds = c->foundKinds;
+  for (int i = from; i < to; i++)
+  {
+    int bored = boredom[i] <= 0;
+    int done = !bored & (found[i] >= foundKinds);
+    int haunted = !bored & !done & (ghosts[i] > 0);
+    int scared = haunted & (fear[i] >= maxFear);
+    int feared = haunted & !scared;
+
+    // every ghost in the room scares the hunter on its own
+    int f = fear[i] + feared * fearRate * ghosts[i];
+    fear[i] = f > maxFear ? maxFear : f;
+    boredom[i] = feared ? boredomMax : boredom[i];
+    check[i] = bored * CHECK_BORED + done * CHECK_FOUND + scared * CHECK_SCARED + feared * CHECK_FEARED;
   }
+}
+
+/// @brief checks the exit conditions of a range of hunters and scares the ones sharing a room with a ghost, without branches so it vectorizes over thousands of hunters
+/// @param t the entity table, ghostsHere and found must already be gathered for the range
+/// @param c the config of the building
+/// @param from the first hunter id checked
+/// @param to one past the last hunter id checked
+void checkHunters(EntityTable *t, SimConfig *c, int from, int to)
+{
+  checkRange(t->fear, t->boredom, t->found, t->ghostsHere, t->check, c, from, to);
+}
 
-  notebook->count--;
-  for (int j = i; j < notebook->count; j++)
+/// @brief acts on the outcome of checkHunters for one hunter, recording its new fear or its exit, and why it left in exitCheck
+/// @param hunter the hunter that was checked
+/// @return returns true if the hunter is still hunting, false once it has left
+bool applyCheck(HunterType *hunter)
+{
+  EntityTable *t = &hunter->building->table;
+  switch (t->check[hunter->id])
   {
-    notebook->hunters[j] = notebook->hunters[j + 1];
+  case CHECK_FEARED:
+    traceFear(hunter->building, hunter->id, hunter->building->table.fear[hunter->id]);
+    return true;
+  case CHECK_BORED:
+    logEvent(LOG_INFO, "HUNTER: %s HAS GOTTEN BORED\n", hunter->name);
+    traceExit(hunter->building, hunter->id, EXIT_BORED);
+    t->exitCheck[hunter->id] = CHECK_BORED;
+    return false;
+  case CHECK_FOUND:
+    logEvent(LOG_INFO, "HUNTER: %s, HAS FOUND %d DIFFERENT GHOSTLY EVIDENCE\n", hunter->name, hunter->building->config.foundKinds);
+    logEvent(LOG_INFO, "HUNTER: %s HAS GOTTEN BORED\n", hunter->name);
+    traceExit(hunter->building, hunter->id, EXIT_FOUND);
+    t->exitCheck[hunter->id] = CHECK_FOUND;
+    return false;
+  case CHECK_SCARED:
+    logEvent(LOG_INFO, "HUNTER: %s, HAS RAN AWAY SCARED\n", hunter->name);
+    logEvent(LOG_INFO, "HUNTER: %s HAS GOTTEN BORED\n", hunter->name);
+    traceExit(hunter->building, hunter->id, EXIT_SCARED);
+    t->exitCheck[hunter->id] = CHECK_SCARED;
+    return false;
+  default:
+    return true;
   }
 }
 
-/// @brief function in which the hunters thread wil be ran, constantly updating the hunter based on randomized conditions posibily moving rooms, collecting/sharing evidence, dropping evidence, or doing nothing updating its exit conditions     
-/// @param hunterArg void pointer, will by typecasted to a hunter argument 
-void *updateHunter(void *hunterArg)
+/// @brief the action half of a hunter step, taken once applyCheck has kept it in the hunt
+/// @param hunter the hunter acting
+void actHunter(HunterType *hunter)
 {
-  HunterType *hunter = (HunterType *)hunterArg;
-  
-  while (hunter->boredom > 0)
+  switch (pickOdds(&hunter->rng, hunter->building->config.hunterOdds, NUM_HUNTER_ACTIONS))
   {
-    if (hunter->hasDifferentGhostly >= 3)
+  case HUNTER_SEARCH:
+    logEvent(LOG_DEBUG, "\n");
+    RoomType *curr = hunter->room;
+    // held for the standard reading too, another hunter sharing into this one holds it
+    lockRoom(curr);
+    if (!hasEvidence(curr))
     {
-      printf("HUNTER: %s, HAS FOUND MORE THAN 3 DIFFERENT GHOSTLY EVIDENCE\n", hunter->name);
-      break;
+      generateStandardEvidence(hunter);
+      metricAction(ACTION_STANDARD);
     }
-    else
+    else if (collectEvidence(hunter))
     {
-
-      if (hasGhost(hunter->room))
-      {
-        if (hunter->fear < 100)
-        {
-          hunter->fear++;
-          hunter->boredom = BOREDOM_MAX;
-        }
-        else
-        {
-          printf("HUNTER: %s, HAS RAN AWAY SCARED\n", hunter->name);
-          break;
-        }
-      }
+      hunter->building->table.boredom[hunter->id] = hunter->building->config.boredomMax;
+      metricAction(ACTION_COLLECT);
     }
-    int c = randInt(0,3);
-    switch (c)
-    {
-    case 0:
-      printf("\n");
-      bool evidenceEmpty = false;
-      RoomType *curr = hunter->room;
-      if (!sem_trywait(&(curr->mutex)))
-      {
-        if (curr->evidence->head != NULL)
-        {
-          if (collectEvidence(hunter)) {
-            hunter->boredom = BOREDOM_MAX; 
-          }
-        }
-        else
-        {
-          evidenceEmpty = true;
-        }
-        sem_post(&(curr->mutex));
-      }
-      if (evidenceEmpty)
-      {
-        generateStandardEvidence(hunter);
-      }
-      break;
+    unlockRoom(curr);
+    break;
 
-    case 1:
-      //  moving
-      printf("\n");
-      RoomType *prev = hunter->room;
-      RoomType *next = NULL;
-      if (!sem_trywait(&(prev->mutex)))
-      {
-        while (true)
-        {
-          next = findRandRoom(hunter->room->rooms);
-          if (!sem_trywait(&(next->mutex)))
-          {
-            updateHunterRoom(hunter, next);
-            printf("HUNTER: %s, HAS MOVED TO THIS ROOM %s\n", hunter->name, next->name);
-            break;
-          }
-        }
-        sem_post(&(prev->mutex));
-        sem_post(&(next->mutex));
-      }
+  case HUNTER_MOVE:
+    logEvent(LOG_DEBUG, "\n");
+    RoomType *prev = hunter->room;
+    RoomType *next = findRandRoom(hunter->building, prev, &hunter->rng);
+    if (next == NULL)
+    {
+      // a room with no connections, stay put
       break;
+    }
+    // both rooms are held while the hunter moves between their rosters
+    lockRooms(prev, next);
+    updateHunterRoom(hunter, next);
+    unlockRooms(prev, next);
+    metricAction(ACTION_MOVE);
+    logEvent(LOG_INFO, "HUNTER: %s, HAS MOVED TO THIS ROOM %s\n", hunter->name, next->name);
+    break;
 
-    case 2:
-      // communiucating
-      if (hasHunters(hunter->room))
+  case HUNTER_SHARE:
+    // communiucating, the room is held so the other hunter can not leave or collect meanwhile
+    lockRoom(hunter->room);
+    if (hasHunters(hunter->room))
+    {
+      HunterType *temp;
+      RoomType *curr = hunter->room;
+      do
       {
-        HunterType *temp;
-        RoomType *curr = hunter->room;
-        do
-        {
-          temp = pickRandomHunter(curr->hunters);
-        } while (temp == hunter);
-        shareGhostlyEvidence(hunter, temp);
-        // only share one piece of evidence right now you can change, it gets too slow
-      }
-      break;
+        temp = pickRandomHunter(&curr->hunters, &hunter->rng);
+      } while (temp == hunter);
+      shareGhostlyEvidence(hunter, temp);
+      metricAction(ACTION_SHARE);
     }
-     hunter->boredom--;
-    sleep(randFloat(0.2, 1));
+    unlockRoom(hunter->room);
+    break;
   }
-  printf("HUNTER: %s HAS GOTTEN BORED\n", hunter->name);
-  return NULL;
+  hunter->building->table.boredom[hunter->id]--;
 }
 
-
 /// @brief picks a random hunter from the given hunter notebook      
 /// @param hunters hunter notebook to randomly pick a hunter from 
+/// @param rng generator of the hunter doing the picking
 
-HunterType *pickRandomHunter(HunterNotebook *hunters)
+HunterType *pickRandomHunter(HunterNotebook *hunters, RandState *rng)
 {
 
-  int a = randInt(0, hunters->count);
+  int a = randInt(rng, 0, hunters->count);
   // return random hunter
   return hunters->hunters[a];
 }
@@ -223,11 +269,13 @@ HunterType *pickRandomHunter(HunterNotebook *hunters)
 void updateHunterRoom(HunterType *hunter, RoomType *room)
 {
   // remove the hunter from the rooms collection
-  removeHunter(hunter, hunter->room->hunters);
+  removeHunter(hunter, &hunter->room->hunters);
   // new room of hunter
   hunter->room = room;
+  hunter->building->table.room[hunter->id] = room;
   // add hunter to the new rooms hunters collection
-  addHunter(hunter, hunter->room->hunters);
+  hunter->roomSlot = addHunter(hunter, &hunter->room->hunters);
+  traceMove(hunter->building, hunter->id, room);
 }
 
 /// @brief initialize standard evidence based on the hunters equipment, and add this to the it's evidence collection        
@@ -235,28 +283,44 @@ void updateHunterRoom(HunterType *hunter, RoomType *room)
 
 void generateStandardEvidence(HunterType *hunter)
 {
-  EvidenceType *e = NULL;
-  EvidenceNode *node = NULL;
+  float val = 0;
   switch (hunter->equipment)
   {
   case EMF:
-    initEvidence(hunter->equipment, randFloat(0, 4.9), &e);
+    val = randFloat(&hunter->rng, 0, 4.9);
     break;
   case TEMPERATURE:
-    initEvidence(hunter->equipment, randFloat(0, 27), &e);
+    val = randFloat(&hunter->rng, 0, 27);
     break;
   case FINGERPRINTS:
-    initEvidence(hunter->equipment, 0, &e);
+    val = 0;
     break;
   case SOUND:
-    initEvidence(hunter->equipment, randFloat(40, 70), &e);
+    val = randFloat(&hunter->rng, 40, 70);
     break;
   }
-  initEvidenceNode(e, &node);
+  addStandardEvidence(hunter, val);
+}
+
+/// @brief adds a standard reading of the hunters equipment to its evidence collection, also used to redo a recorded reading when replaying a trace
+/// @param hunter hunter taking the reading
+/// @param val the value read
+/// @return the evidence that was added
+EvidenceType *addStandardEvidence(HunterType *hunter, float val)
+{
+  EvidenceType *e = NULL;
+  EvidenceNode *node = NULL;
+  initEvidence(hunter->pool, hunter->equipment, val, &e);
+  initEvidenceNode(hunter->pool, e, &node);
   addEvidence(node, hunter->evidence);
-  initEvidenceNode(e, &node);
-  addEvidence(node, hunter->building->evidence);
-  printf("HUNTER: %s, HAS GENERATED SOME STANDARD EVIDENCE OF THIS TYPE %s\n", hunter->name, evidenceEnumToStr(node->evidence->type));
+  if (isGhostly(e))
+  {
+    learnGhostly(hunter, e->type);
+  }
+  appendEvidenceLog(hunter->building->evidence, e);
+  traceStandard(hunter->building, hunter->id, e);
+  logEvent(LOG_INFO, "HUNTER: %s, HAS GENERATED SOME STANDARD EVIDENCE OF THIS TYPE %s\n", hunter->name, evidenceEnumToStr(e->type));
+  return e;
 }
 
 
@@ -278,4 +342,4 @@ void printHunters(HunterNotebook *n)
   {
     printHunter(n->hunters[i]);
   }
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "defs.h"
+
+/*
+    Building layouts are maps compiled ahead of time, with -o, into
+    the form a building keeps them in, so a hunt can start on one with
+    nothing read, parsed or copied:
+
+        header      "GHLY", u32 version, u32 roomCount, u32 spawn,
+                    u32 stringSize, u32 neighbours, u64 file size,
+                    u64 start of each section below
+        adjOffset   (roomCount + 1) x i32, CSR offsets into adjRooms
+        adjRooms    neighbours x i32, the ids of each rooms neighbours
+        names       roomCount x u32, where each name starts in strings
+        strings     stringSize bytes of room names, each terminated
+
+    Every section starts on an 8 byte boundary and is found by its
+    offset from the start of the file, never by a pointer, so the file
+    works wherever it is mapped. Numbers are in the byte order of the
+    machine that compiled it. The adjacency is built by buildAdjacency,
+    exactly as buildFromMap builds it, so a hunt plays out the same on
+    a layout as on the map it was compiled from.
+
+    openLayout maps the file read only and shared, so every hunt of a
+    batch, and every process running on the same file, reads the same
+    pages of the page cache. A building made from it points its room
+    names and adjacency into the mapping and only allocates its rooms,
+    which change during a hunt. compileLayout writes PATH.tmp and
+    renames it over PATH, so processes still running on the old layout
+    keep the file they mapped.
+*/
+
+#define LAYOUT_ALIGN 8
+
+typedef struct LayoutHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t roomCount;
+  uint32_t spawn;
+  uint32_t stringSize; // bytes of room names, terminators included
+  uint32_t neighbours; // entries of adjRooms
+  uint64_t size;       // of the whole file
+  uint64_t adjOffset;  // where each section starts, from the start of the file
+  uint64_t adjRooms;
+  uint64_t names;
+  uint64_t strings;
+} LayoutHeader;
+
+/// @brief rounds a position up to the next section boundary
+/// @param n the position
+/// @return the first aligned position at or after n
+static uint64_t alignUp(uint64_t n)
+{
+  return (n + LAYOUT_ALIGN - 1) & ~(uint64_t)(LAYOUT_ALIGN - 1);
+}
+
+/// @brief compiles a map into a layout file, written to PATH.tmp and renamed over PATH
+/// @param map the map being compiled
+/// @param path the file written
+/// @return 0 on success, -1 if the map is too big for the format or the file could not be written
+int compileLayout(BuildingMap *map, const char *path)
+{
+  size_t stringSize = 0;
+  for (int i = 0; i < map->roomCount; i++)
+  {
+    stringSize += strnlen(map->names[i], MAX_STR - 1) + 1;
+  }
+  if (stringSize > UINT32_MAX)
+  {
+    return -1;
+  }
+
+  // a bare building is enough for buildAdjacency, which only needs the room count
+  BuildingType b;
+  memset(&b, 0, sizeof(b));
+  b.roomCount = map->roomCount;
+  buildAdjacency(&b, map->edges, map->edgeCount);
+  int n = map->roomCount;
+
+  LayoutHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, LAYOUT_MAGIC, sizeof(h.magic));
+  h.version = LAYOUT_VERSION;
+  h.roomCount = n;
+  h.spawn = map->spawn;
+  h.stringSize = stringSize;
+  h.neighbours = b.adjOffset[n];
+  h.adjOffset = alignUp(sizeof(h));
+  h.adjRooms = alignUp(h.adjOffset + (uint64_t)(n + 1) * sizeof(int));
+  h.names = alignUp(h.adjRooms + (uint64_t)h.neighbours * sizeof(int));
+  h.strings = alignUp(h.names + (uint64_t)n * sizeof(uint32_t));
+  h.size = alignUp(h.strings + stringSize);
+
+  // the whole file is laid out in memory and written in one go, padding zeroed by calloc
+  unsigned char *data = calloc(1, h.size);
+  memcpy(data, &h, sizeof(h));
+  memcpy(data + h.adjOffset, b.adjOffset, (n + 1) * sizeof(int));
+  memcpy(data + h.adjRooms, b.adjRooms, h.neighbours * sizeof(int));
+  uint32_t *names = (uint32_t *)(data + h.names);
+  uint32_t at = 0;
+  for (int i = 0; i < n; i++)
+  {
+    size_t len = strnlen(map->names[i], MAX_STR - 1);
+    names[i] = at;
+    memcpy(data + h.strings + at, map->names[i], len);
+    at += len + 1;
+  }
+  free((int *)b.adjOffset);
+  free((int *)b.adjRooms);
+
+  char tmp[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *f = fopen(tmp, "wb");
+  bool ok = f != NULL;
+  if (ok)
+  {
+    ok = fwrite(data, 1, h.size, f) == h.size;
+    ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok)
+    {
+      remove(tmp);
+    }
+  }
+  free(data);
+  return ok ? 0 : -1;
+}
+
+/// @brief checks that a section lies inside the file and starts on a boundary
+/// @param h the header of the file
+/// @param start where the section starts
+/// @param bytes the length of the section
+/// @return true if it does
+static bool inLayout(const LayoutHeader *h, uint64_t start, uint64_t bytes)
+{
+  return start % LAYOUT_ALIGN == 0 && start >= sizeof(LayoutHeader) && start <= h->size && bytes <= h->size - start;
+}
+
+/// @brief checks a mapped layout before any building trusts it, without copying or allocating anything
+/// @param base the start of the mapping
+/// @param size the length of the file
+/// @return true if every section, offset, neighbour and name is in bounds
+static bool checkLayout(const unsigned char *base, size_t size)
+{
+  const LayoutHeader *h = (const LayoutHeader *)base;
+  if (memcmp(h->magic, LAYOUT_MAGIC, sizeof(h->magic)) != 0 || h->version != LAYOUT_VERSION || h->size != size)
+  {
+    return false;
+  }
+  uint64_t n = h->roomCount;
+  if (n == 0 || n > INT_MAX || h->spawn >= n || h->neighbours > INT_MAX)
+  {
+    return false;
+  }
+  if (!inLayout(h, h->adjOffset, (n + 1) * sizeof(int)) || !inLayout(h, h->adjRooms, (uint64_t)h->neighbours * sizeof(int)) ||
+      !inLayout(h, h->names, n * sizeof(uint32_t)) || !inLayout(h, h->strings, h->stringSize))
+  {
+    return false;
+  }
+
+  const int *adjOffset = (const int *)(base + h->adjOffset);
+  const int *adjRooms = (const int *)(base + h->adjRooms);
+  if (adjOffset[0] != 0 || adjOffset[n] != (int)h->neighbours)
+  {
+    return false;
+  }
+  for (uint64_t i = 0; i < n; i++)
+  {
+    if (adjOffset[i + 1] < adjOffset[i])
+    {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < h->neighbours; i++)
+  {
+    if (adjRooms[i] < 0 || (uint64_t)adjRooms[i] >= n)
+    {
+      return false;
+    }
+  }
+
+  // every name has to end inside the strings, and short enough for the buffers traces and checkpoints read names into
+  const uint32_t *names = (const uint32_t *)(base + h->names);
+  const char *strings = (const char *)(base + h->strings);
+  for (uint64_t i = 0; i < n; i++)
+  {
+    if (names[i] >= h->stringSize)
+    {
+      return false;
+    }
+    size_t left = h->stringSize - names[i];
+    if (memchr(strings + names[i], '\0', left < MAX_STR ? left : MAX_STR) == NULL)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// @brief maps a layout file read only and checks it
+/// @param path the file compiled by compileLayout
+/// @param layout double pointer to which the layout is stored
+/// @return 0 on success, -1 if the file could not be mapped or is not a valid layout
+int openLayout(const char *path, BuildingLayout **layout)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LayoutHeader))
+  {
+    close(fd);
+    return -1;
+  }
+  // the mapping holds its own reference to the file
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    return -1;
+  }
+  if (!checkLayout(base, st.st_size))
+  {
+    munmap(base, st.st_size);
+    return -1;
+  }
+
+  const unsigned char *p = base;
+  const LayoutHeader *h = base;
+  *layout = calloc(1, sizeof(BuildingLayout));
+  (*layout)->base = base;
+  (*layout)->size = st.st_size;
+  (*layout)->roomCount = h->roomCount;
+  (*layout)->spawn = h->spawn;
+  (*layout)->names = (const uint32_t *)(p + h->names);
+  (*layout)->strings = (const char *)(p + h->strings);
+  (*layout)->adjOffset = (const int *)(p + h->adjOffset);
+  (*layout)->adjRooms = (const int *)(p + h->adjRooms);
+  return 0;
+}
+
+/// @brief unmaps a layout, every building made from it must already be cleaned up
+/// @param layout the layout being closed
+void closeLayout(BuildingLayout *layout)
+{
+  munmap(layout->base, layout->size);
+  free(layout);
+}
+
+/// @brief populate building with the rooms of a layout, sharing its names and adjacency instead of copying them
+/// @param building building to be populated
+/// @param layout the layout, which must stay open until the building is cleaned up
+void buildFromLayout(BuildingType *building, const BuildingLayout *layout)
+{
+  initRooms(building, layout->roomCount);
+  for (int i = 0; i < layout->roomCount; i++)
+  {
+    initRoom(layout->strings + layout->names[i], i, &building->rooms[i]);
+  }
+  building->layout = layout;
+  building->adjOffset = layout->adjOffset;
+  building->adjRooms = layout->adjRooms;
+  building->spawn = building->roomIndex[layout->spawn];
+}
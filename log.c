@@ -0,0 +1,211 @@
+#include "defs.h"
+
+/*
+    Event logging. Every thread formats its events into its own ring
+    buffer and carries on; a background writer drains all the rings and
+    hands the text to stdout in large writes, so hunters and the ghost
+    never wait on the stdio lock. Until startLog is called (and after
+    stopLog) events are printed directly instead.
+*/
+
+LogLevel logLevel = LOG_INFO;
+
+static _Thread_local LogRing *myRing = NULL;
+static _Thread_local unsigned myGeneration = 0;
+static atomic_uint generation = 0; // bumped by stopLog, a ring from an older generation has been freed
+static _Atomic(LogRing *) rings = NULL;
+static pthread_mutex_t ringsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t writer;
+static atomic_bool running = false;
+static atomic_bool stopping = false;
+
+/// @brief finds the ring of the calling thread, creating and registering it on first use and on first use after a stopLog
+/// @return the calling threads ring
+static LogRing *threadRing(void)
+{
+  unsigned current = atomic_load_explicit(&generation, memory_order_acquire);
+  if (myRing == NULL || myGeneration != current)
+  {
+    myGeneration = current;
+    myRing = calloc(1, sizeof(LogRing));
+    myRing->data = malloc(LOG_RING_SIZE);
+    atomic_init(&myRing->head, 0);
+    atomic_init(&myRing->tail, 0);
+
+    pthread_mutex_lock(&ringsMutex);
+    myRing->next = atomic_load(&rings);
+    atomic_store_explicit(&rings, myRing, memory_order_release);
+    pthread_mutex_unlock(&ringsMutex);
+  }
+  return myRing;
+}
+
+/// @brief copies everything written to a ring so far into the writers buffer and hands the space back
+/// @param r the ring being drained
+/// @param out the writers buffer, written out whenever it fills
+/// @param used how much of out is in use
+/// @return the number of bytes drained
+static size_t drainRing(LogRing *r, char *out, size_t *used)
+{
+  size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  size_t drained = head - tail;
+  while (tail != head)
+  {
+    size_t at = tail % LOG_RING_SIZE;
+    size_t n = head - tail;
+    if (n > LOG_RING_SIZE - at)
+    {
+      n = LOG_RING_SIZE - at;
+    }
+    if (n > LOG_WRITE_SIZE - *used)
+    {
+      n = LOG_WRITE_SIZE - *used;
+    }
+    memcpy(out + *used, r->data + at, n);
+    *used += n;
+    tail += n;
+    if (*used == LOG_WRITE_SIZE)
+    {
+      fwrite(out, 1, *used, stdout);
+      *used = 0;
+    }
+  }
+  atomic_store_explicit(&r->tail, tail, memory_order_release);
+  return drained;
+}
+
+/// @brief background thread that drains every ring, sleeping briefly whenever there is nothing to write
+/// @param arg unused
+static void *logWriter(void *arg)
+{
+  (void)arg;
+  char *out = malloc(LOG_WRITE_SIZE);
+  struct timespec idle = {0, 1000000};
+  while (true)
+  {
+    bool stop = atomic_load(&stopping);
+    size_t used = 0;
+    size_t drained = 0;
+    for (LogRing *r = atomic_load_explicit(&rings, memory_order_acquire); r != NULL; r = r->next)
+    {
+      drained += drainRing(r, out, &used);
+    }
+    if (used > 0)
+    {
+      fwrite(out, 1, used, stdout);
+    }
+    if (drained > 0)
+    {
+      fflush(stdout);
+    }
+    // one last pass after stopping is seen catches anything written before stopLog was called
+    if (stop)
+    {
+      break;
+    }
+    if (drained == 0)
+    {
+      nanosleep(&idle, NULL);
+    }
+  }
+  free(out);
+  return NULL;
+}
+
+/// @brief starts the background writer, events logged from here on are buffered
+void startLog(void)
+{
+  if (atomic_load(&running))
+  {
+    return;
+  }
+  fflush(stdout);
+  atomic_store(&stopping, false);
+  atomic_store(&running, true);
+  pthread_create(&writer, NULL, logWriter, NULL);
+}
+
+/// @brief blocks until everything logged so far by every thread has been written
+void flushLog(void)
+{
+  if (!atomic_load(&running))
+  {
+    fflush(stdout);
+    return;
+  }
+  struct timespec wait = {0, 100000};
+  for (LogRing *r = atomic_load_explicit(&rings, memory_order_acquire); r != NULL; r = r->next)
+  {
+    while (atomic_load_explicit(&r->tail, memory_order_acquire) != atomic_load_explicit(&r->head, memory_order_acquire))
+    {
+      nanosleep(&wait, NULL);
+    }
+  }
+}
+
+/// @brief writes out everything still buffered, stops the writer and frees every ring, only call once no other thread is logging
+///        threads that log after it print directly, and make themselves a new ring once logging is started again
+void stopLog(void)
+{
+  if (!atomic_load(&running))
+  {
+    return;
+  }
+  atomic_store(&stopping, true);
+  pthread_join(writer, NULL);
+  atomic_store(&running, false);
+  fflush(stdout);
+
+  pthread_mutex_lock(&ringsMutex);
+  LogRing *r = atomic_exchange(&rings, NULL);
+  while (r != NULL)
+  {
+    LogRing *next = r->next;
+    free(r->data);
+    free(r);
+    r = next;
+  }
+  atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+  pthread_mutex_unlock(&ringsMutex);
+  myRing = NULL;
+}
+
+/// @brief formats an event into the calling threads ring, use the logEvent macro rather than calling this directly
+/// @param fmt printf style format string followed by its arguments
+void writeLog(const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  if (!atomic_load_explicit(&running, memory_order_relaxed))
+  {
+    vprintf(fmt, args);
+    va_end(args);
+    return;
+  }
+
+  char line[LOG_MAX_LINE];
+  int len = vsnprintf(line, LOG_MAX_LINE, fmt, args);
+  va_end(args);
+  if (len < 0)
+  {
+    return;
+  }
+  if (len >= LOG_MAX_LINE)
+  {
+    len = LOG_MAX_LINE - 1;
+  }
+
+  LogRing *r = threadRing();
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  // wait for the writer to make room rather than drop the event
+  while (LOG_RING_SIZE - (head - atomic_load_explicit(&r->tail, memory_order_acquire)) < (size_t)len)
+  {
+    sched_yield();
+  }
+  size_t at = head % LOG_RING_SIZE;
+  size_t first = (size_t)len < LOG_RING_SIZE - at ? (size_t)len : LOG_RING_SIZE - at;
+  memcpy(r->data + at, line, first);
+  memcpy(r->data, line + first, len - first);
+  atomic_store_explicit(&r->head, head + len, memory_order_release);
+}
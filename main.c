@@ -2,66 +2,552 @@
 
 int main(int argc, char *argv[])
 {
-  pthread_t threads[MAX_HUNTERS + 1];
-  HunterType *hunters[MAX_HUNTERS];
-  // Initialize a random seed for the random number generators
-  srand(time(NULL));
+  // Initialize a random seed for the random number generators, -s replays a previous seed
+  uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
 
-  BuildingType *b = NULL;
-  initBuilding(&b);
-  populateRooms(b);
+  // -b N runs N headless hunts instead of one interactive hunt, -j sets the worker thread count
+  // -d runs the interactive hunt on the discrete event scheduler instead of in real time on a worker pool
+  // -k runs hunts, interactive or batch, in lock step ticks where every hunter and ghost steps once per tick
+  // -j also sets how many pool workers step the hunters and ghosts of an interactive hunt, one per core by default
+  // -m loads the building from a map file instead of the default house, -p prints its rooms
+  // -q silences every event, -v adds the debug spacing, batch runs are silent unless -v is given
+  // -t records the hunt as a binary trace into a file, or for a batch every hunt into a directory
+  // -H sets how many hunters are sent in, 4 by default, and -G how many ghosts haunt the building, 1 by default
+  // -r replays a recorded trace, -g seeks to an event (the end by default) and -n then steps that many events, logging each
+  // -c loads parameters from a config file and -P key=value sets one, -C prints the config that would be used and exits
+  // -S runs a parameter sweep file, -b hunts per configuration, over its whole grid or -R sampled configurations
+  // -x plays a pool hunt that many times as fast as real time, 0 or unlimited as fast as it can without sleeping
+  // -w checkpoints a -d or -k hunt into a file every -e simulated seconds, -l resumes a hunt from its checkpoint
+  // -o compiles the building, -m or the default house, into a layout file and exits, -L runs on a compiled layout
+  // -a writes the statistics of a batch so far as a CSV row into a file every -A hunts, and once more at the end
+  long batchRuns = 0;
+  int batchThreads = 0;
+  bool discrete = false;
+  bool ticks = false;
+  bool printMap = false;
+  int verbosity = -1;
+  BuildingMap *map = NULL;
+  const char *tracePath = NULL;
+  const char *replayPath = NULL;
+  long seekTo = -1;
+  long replaySteps = 0;
+  int hunterCount = DEFAULT_HUNTERS;
+  int ghostCount = DEFAULT_GHOSTS;
+  SimConfig config;
+  defaultConfig(&config);
+  bool showConfig = false;
+  const char *sweepPath = NULL;
+  long sweepSamples = 0;
+  double speed = POOL_SPEED;
+  const char *checkpointPath = NULL;
+  double checkpointEvery = CHECKPOINT_EVERY;
+  const char *resumePath = NULL;
+  const char *compilePath = NULL;
+  BuildingLayout *layout = NULL;
+  const char *rowsPath = NULL;
+  long rowEvery = BATCH_ROW_EVERY;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:j:dks:m:pqvt:r:g:n:H:G:c:P:CS:R:x:w:e:l:o:L:a:A:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      if (loadConfig(optarg, &config) != 0)
+      {
+        fprintf(stderr, "could not load config %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'P':
+      if (setConfigOption(&config, optarg) != 0)
+      {
+        fprintf(stderr, "bad parameter %s, expected key=number\n", optarg);
+        return 1;
+      }
+      break;
+    case 'C':
+      showConfig = true;
+      break;
+    case 'S':
+      sweepPath = optarg;
+      break;
+    case 'R':
+      sweepSamples = atol(optarg);
+      break;
+    case 'm':
+      if (map != NULL)
+      {
+        cleanupMap(map);
+      }
+      if (loadMap(optarg, &map) != 0)
+      {
+        fprintf(stderr, "could not load map %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'p':
+      printMap = true;
+      break;
+    case 't':
+      tracePath = optarg;
+      break;
+    case 'r':
+      replayPath = optarg;
+      break;
+    case 'g':
+      seekTo = atol(optarg);
+      break;
+    case 'n':
+      replaySteps = atol(optarg);
+      break;
+    case 'H':
+      hunterCount = atoi(optarg);
+      if (hunterCount < 1)
+      {
+        fprintf(stderr, "need at least one hunter\n");
+        return 1;
+      }
+      break;
+    case 'G':
+      ghostCount = atoi(optarg);
+      if (ghostCount < 1)
+      {
+        fprintf(stderr, "need at least one ghost\n");
+        return 1;
+      }
+      break;
+    case 'q':
+      verbosity = LOG_NONE;
+      break;
+    case 'v':
+      verbosity = LOG_DEBUG;
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'd':
+      discrete = true;
+      break;
+    case 'k':
+      ticks = true;
+      break;
+    case 'b':
+      batchRuns = atol(optarg);
+      break;
+    case 'j':
+      batchThreads = atoi(optarg);
+      break;
+    case 'x':
+      speed = strcmp(optarg, "unlimited") == 0 ? POOL_UNLIMITED : atof(optarg);
+      if (speed < 0)
+      {
+        fprintf(stderr, "the speed must not be negative\n");
+        return 1;
+      }
+      break;
+    case 'w':
+      checkpointPath = optarg;
+      break;
+    case 'e':
+      checkpointEvery = atof(optarg);
+      if (checkpointEvery <= 0)
+      {
+        fprintf(stderr, "checkpoints need a positive number of seconds between them\n");
+        return 1;
+      }
+      break;
+    case 'l':
+      resumePath = optarg;
+      break;
+    case 'o':
+      compilePath = optarg;
+      break;
+    case 'a':
+      rowsPath = optarg;
+      break;
+    case 'A':
+      rowEvery = atol(optarg);
+      if (rowEvery < 1)
+      {
+        fprintf(stderr, "rows need at least one hunt between them\n");
+        return 1;
+      }
+      break;
+    case 'L':
+      if (layout != NULL)
+      {
+        closeLayout(layout);
+      }
+      if (openLayout(optarg, &layout) != 0)
+      {
+        fprintf(stderr, "could not open layout %s\n", optarg);
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d|-k] [-p] [-q|-v] [-H hunters] [-G ghosts] [-m map] [-t trace] [-s seed] [-b runs] [-j threads] [-r trace [-g event] [-n steps]] [-c config] [-P key=value] [-C] [-S sweep [-R samples]] [-x speed] [-w checkpoint [-e seconds]] [-l checkpoint] [-o layout] [-L layout] [-a rows [-A runs]]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // a pool hunt is never between steps everywhere at once, a resumed one runs the way it was checkpointed
+  if (checkpointPath != NULL && (batchRuns > 0 || sweepPath != NULL || replayPath != NULL || (!discrete && !ticks && resumePath == NULL)))
+  {
+    fprintf(stderr, "only a single hunt run with -d or -k can be checkpointed\n");
+    return 1;
+  }
+  if (resumePath != NULL && tracePath != NULL)
+  {
+    fprintf(stderr, "a resumed hunt can not be recorded\n");
+    return 1;
+  }
+  if (rowsPath != NULL && (batchRuns <= 0 || sweepPath != NULL || replayPath != NULL))
+  {
+    fprintf(stderr, "only a batch run with -b writes rows of statistics\n");
+    return 1;
+  }
+  if (layout != NULL && map != NULL)
+  {
+    fprintf(stderr, "a hunt runs on either a map or a layout\n");
+    return 1;
+  }
+
+  const char *problem = checkConfig(&config);
+  if (problem != NULL)
+  {
+    fprintf(stderr, "bad config: %s\n", problem);
+    return 1;
+  }
+  if (showConfig)
+  {
+    printConfig(&config, stdout);
+    return 0;
+  }
+  if (compilePath != NULL)
+  {
+    BuildingMap house;
+    houseMap(&house);
+    int compiled = compileLayout(map != NULL ? map : &house, compilePath);
+    if (map != NULL)
+    {
+      cleanupMap(map);
+    }
+    if (compiled != 0)
+    {
+      fprintf(stderr, "could not compile a layout into %s\n", compilePath);
+      return 1;
+    }
+    return 0;
+  }
 
-  for (int i = 0; i < MAX_HUNTERS; i++)
+  metricPhase(PHASE_SETUP);
+
+  if (replayPath != NULL)
   {
-    char name[MAX_STR];
-    HunterType *h = NULL;
-    printf("\nPlease enter a Hunter name: ");
-    scanf("%[^\n]%*c", name);
-    initHunter(name, i, b, &h);
-    hunters[i] = h;
+    if (map != NULL)
+    {
+      cleanupMap(map);
+    }
+    if (layout != NULL)
+    {
+      closeLayout(layout);
+    }
+    Replay *r = NULL;
+    if (loadReplay(replayPath, &r) != 0)
+    {
+      fprintf(stderr, "could not replay %s\n", replayPath);
+      return 1;
+    }
+    if (verbosity >= 0)
+    {
+      logLevel = verbosity;
+    }
+    seekReplay(r, seekTo >= 0 ? seekTo : r->eventCount);
+    for (long i = 0; i < replaySteps; i++)
+    {
+      if (!stepReplay(r))
+      {
+        break;
+      }
+    }
+    printReplay(r);
+    cleanupReplay(r);
+    return 0;
   }
 
-  GhostType *g = NULL;
-  initGhost(b, &g);
+  if (sweepPath != NULL)
+  {
+    Sweep *sweep = NULL;
+    if (loadSweep(sweepPath, &sweep) != 0)
+    {
+      fprintf(stderr, "could not load sweep %s\n", sweepPath);
+      return 1;
+    }
+    if (expandSweep(sweep, &config, sweepSamples, seed) != 0)
+    {
+      fprintf(stderr, "a sweep without -R can only list values, and at most %d combinations of them\n", SWEEP_MAX_CONFIGS);
+      cleanupSweep(sweep);
+      return 1;
+    }
+    for (long i = 0; i < sweep->configCount; i++)
+    {
+      problem = checkConfig(&sweep->configs[i]);
+      if (problem != NULL)
+      {
+        fprintf(stderr, "bad config %ld of the sweep: %s\n", i, problem);
+        cleanupSweep(sweep);
+        return 1;
+      }
+    }
+    logLevel = verbosity >= 0 ? verbosity : LOG_NONE;
+    startLog();
+    SimOptions opts = {map, NULL, hunterCount, ghostCount, ticks, &config, layout};
+    metricPhase(PHASE_HUNT);
+    runSweep(sweep, batchRuns > 0 ? batchRuns : SWEEP_DEFAULT_RUNS, batchThreads, seed, &opts, stdout);
+    stopLog();
+    metricPhase(PHASE_REPORT);
+    fprintf(stderr, "SEED: %llu\n", (unsigned long long)seed);
+    cleanupSweep(sweep);
+    if (map != NULL)
+    {
+      cleanupMap(map);
+    }
+    if (layout != NULL)
+    {
+      closeLayout(layout);
+    }
+    metricPrint();
+    return 0;
+  }
 
+  if (batchRuns > 0)
+  {
+    logLevel = verbosity >= 0 ? verbosity : LOG_NONE;
+    startLog();
+    FILE *rows = NULL;
+    if (rowsPath != NULL && (rows = fopen(rowsPath, "w")) == NULL)
+    {
+      fprintf(stderr, "could not write %s\n", rowsPath);
+      return 1;
+    }
+    BatchStats stats;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    SimOptions opts = {map, tracePath, hunterCount, ghostCount, ticks, &config, layout};
+    metricPhase(PHASE_HUNT);
+    runBatch(batchRuns, batchThreads, seed, &opts, rows, rowEvery, &stats);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stopLog();
+    metricPhase(PHASE_REPORT);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("SEED: %llu\n", (unsigned long long)seed);
+    printBatchStats(&stats);
+    printf("WALL TIME: %.3f s (%.0f runs/s)\n", secs, stats.runs / secs);
+    cleanupBatchStats(&stats);
+    if (rows != NULL)
+    {
+      fclose(rows);
+    }
+    if (map != NULL)
+    {
+      cleanupMap(map);
+    }
+    if (layout != NULL)
+    {
+      closeLayout(layout);
+    }
+    metricPrint();
+    return 0;
+  }
 
-// creating threads 
-  for (int i = 0; i < MAX_HUNTERS; i++)
+  BuildingType *b = NULL;
+  Scheduler *s = NULL;
+  HunterType **hunters;
+  if (resumePath != NULL)
   {
-    printHunter(hunters[i]);
-    printf("STARTING THREAD\n");
-    pthread_create(threads + i, NULL, updateHunter, hunters[i]);
+    // everything, down to the config and the hunters names, comes from the checkpoint
+    if (map != NULL)
+    {
+      cleanupMap(map);
+    }
+    if (resumeCheckpoint(resumePath, &b, &s) != 0)
+    {
+      fprintf(stderr, "could not resume %s\n", resumePath);
+      return 1;
+    }
+    ticks = s->left != NULL;
+    discrete = !ticks;
+    seed = b->seed;
+    hunterCount = b->noteBook->count;
+    ghostCount = b->ghostCount;
+    hunters = malloc(hunterCount * sizeof(HunterType *));
+    memcpy(hunters, b->noteBook->hunters, hunterCount * sizeof(HunterType *));
+    if (printMap)
+    {
+      printBuilding(b);
+    }
+    printf("RESUMING THE HUNT FROM %.2f SIMULATED SECONDS\n", s->now);
+    if (verbosity >= 0)
+    {
+      logLevel = verbosity;
+    }
+    startLog();
   }
+  else
+  {
+    initBuilding(&b, seed);
+    b->config = config;
+    if (layout != NULL)
+    {
+      buildFromLayout(b, layout);
+    }
+    else if (map != NULL)
+    {
+      buildFromMap(b, map);
+      cleanupMap(map);
+    }
+    else
+    {
+      populateRooms(b);
+    }
+    if (printMap)
+    {
+      printBuilding(b);
+    }
 
+    hunters = malloc(hunterCount * sizeof(HunterType *));
+    for (int i = 0; i < hunterCount; i++)
+    {
+      char name[MAX_STR];
+      HunterType *h = NULL;
+      printf("\nPlease enter a Hunter name: ");
+      // the width is MAX_STR - 1, the rest of a longer line is dropped, and once input runs out hunters are named as in a batch
+      int got = scanf("%63[^\n]", name);
+      scanf("%*[^\n]");
+      scanf("%*c");
+      if (got != 1)
+      {
+        snprintf(name, MAX_STR, "Hunter %d", i + 1);
+      }
+      initHunter(name, i % NUM_EVIDENCE_TYPES, b, &h);
+      hunters[i] = h;
+    }
 
-  pthread_create(threads + MAX_HUNTERS, NULL, updateGhost, g);
+    if (verbosity >= 0)
+    {
+      logLevel = verbosity;
+    }
+    startLog();
+
+    for (int i = 0; i < ghostCount; i++)
+    {
+      GhostType *g = NULL;
+      initGhost(b, &g);
+    }
+
+    if (discrete || ticks)
+    {
+      initScheduler(&s);
+    }
+    if (discrete && !ticks)
+    {
+      scheduleBuilding(s, b);
+    }
+  }
+  if (tracePath != NULL && startTrace(b, tracePath, s != NULL ? &s->now : NULL) != 0)
+  {
+    fprintf(stderr, "could not record %s\n", tracePath);
+  }
+  if (checkpointPath != NULL && startCheckpoints(s, b, checkpointPath, checkpointEvery) != 0)
+  {
+    fprintf(stderr, "could not checkpoint to %s\n", checkpointPath);
+  }
 
-  for (int i = 0; i < MAX_HUNTERS + 1; i++)
+  metricPhase(PHASE_HUNT);
+  if (ticks)
+  {
+    runTicks(s, b);
+    flushLog();
+    printf("\nHUNT LASTED %.0f TICKS (%.2f SIMULATED SECONDS)\n", s->now / TICK_LENGTH, s->now);
+    stopCheckpoints(s);
+    cleanupScheduler(s);
+  }
+  else if (discrete)
   {
-    pthread_join(threads[i], NULL);
+    runScheduler(s);
+    flushLog();
+    printf("\nHUNT LASTED %.2f SIMULATED SECONDS\n", s->now);
+    stopCheckpoints(s);
+    cleanupScheduler(s);
+  }
+  else
+  {
+    for (int i = 0; i < hunterCount; i++)
+    {
+      printHunter(hunters[i]);
+    }
+    // every hunter and ghost shares a few worker threads instead of getting its own
+    WorkerPool *pool = NULL;
+    initWorkerPool(&pool, b, batchThreads, speed);
+    printf("STARTING %d WORKERS\n", pool->count);
+    runWorkerPool(pool);
+    flushLog();
+    long steps = 0, steals = 0;
+    for (int i = 0; i < pool->count; i++)
+    {
+      steps += pool->workers[i].steps;
+      steals += pool->workers[i].steals;
+    }
+    printf("\nHUNT LASTED %.2f SIMULATED SECONDS IN %.2f SECONDS ON %d WORKERS (%ld STEPS, %ld STOLEN)\n", pool->simulated, pool->elapsed, pool->count, steps,
+           steals);
+    printRoomLocks(b);
+    cleanupWorkerPool(pool);
   }
 
+  stopTrace(b);
+  stopLog();
+  metricPhase(PHASE_REPORT);
+
   // printWinner 
   bool areScared = true;
-  for (int i = 0; i < MAX_HUNTERS; i++) {
-    if (!(hunters[i]->fear >= MAX_FEAR)) {
+  for (int i = 0; i < hunterCount; i++) {
+    if (!(b->table.fear[hunters[i]->id] >= b->config.maxFear)) {
         areScared = false; 
     }
     else {
       printHunter(hunters[i]);
     }
   }
+  // each ghost is identified on its own, from the evidence the hunters collected from it
+  int identified = identifyGhosts(b);
   if (areScared) {
-    printf("THE GHOST HAS WON!\n");
-    for (int i = 0; i < MAX_HUNTERS; i++) {
+    printf(ghostCount == 1 ? "THE GHOST HAS WON!\n" : "THE GHOSTS HAVE WON!\n");
+    for (int i = 0; i < hunterCount; i++) {
       printHunter(hunters[i]);
     }
   }
   else {
-    printf("\nHUNTERS HAVE WON WITH THE MISSING EVIDENCE BEING %s\n", evidenceEnumToStr(g->type));
+    printf("\nHUNTERS HAVE WON, IDENTIFYING %d OF %d GHOSTS\n", identified, ghostCount);
+  }
+  for (int i = 0; i < ghostCount; i++) {
+    printGhost(b->ghosts[i]);
   }
-  printGhost(g);
+  unsigned team = atomic_load(&b->table.team);
+  printf("THE TEAM FOUND %d KINDS OF GHOSTLY EVIDENCE:", __builtin_popcount(team));
+  for (int t = 0; t < NUM_EVIDENCE_TYPES; t++) {
+    if (team & (1u << t)) {
+      printf(" %s", evidenceEnumToStr(t));
+    }
+  }
+  printf("\n");
+  printf("SEED: %llu\n", (unsigned long long)seed);
 
   cleanupBuilding(b);
+  if (layout != NULL)
+  {
+    closeLayout(layout);
+  }
+  free(hunters);
+  metricPrint();
   return 0;
 }
\ No newline at end of file
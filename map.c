@@ -0,0 +1,212 @@
+#include "defs.h"
+
+/*
+    Building map files are plain text:
+
+        # comments and blank lines are ignored
+        rooms 3
+        Van
+        Hallway
+        Kitchen
+        edges 2
+        0 1
+        1 2
+        spawn 0
+
+    Room names are one per line and may contain spaces, rooms are
+    numbered from 0 in the order they are listed. Every edge connects
+    two rooms in both directions. spawn is the room the hunters start
+    in and is optional, defaulting to room 0.
+*/
+
+/// @brief moves a cursor past the current line
+/// @param p the cursor
+/// @param end one past the last character of the buffer
+/// @return the start of the next line
+static char *nextLine(char *p, char *end)
+{
+  while (p < end && *p != '\n')
+  {
+    p++;
+  }
+  return p < end ? p + 1 : end;
+}
+
+/// @brief moves a cursor past blank lines, comments and leading whitespace
+/// @param p the cursor
+/// @param end one past the last character of the buffer
+/// @return the first meaningful character, or end
+static char *skipBlank(char *p, char *end)
+{
+  while (p < end)
+  {
+    if (*p == '#')
+    {
+      p = nextLine(p, end);
+    }
+    else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+      p++;
+    }
+    else
+    {
+      break;
+    }
+  }
+  return p;
+}
+
+/// @brief reads a keyword followed by an integer, eg. "rooms 14"
+/// @param p the cursor, moved past the integer on success
+/// @param end one past the last character of the buffer
+/// @param key the keyword expected
+/// @param value where the integer is stored
+/// @return true if the keyword and integer were found
+static bool readKeyed(char **p, char *end, const char *key, long *value)
+{
+  size_t len = strlen(key);
+  *p = skipBlank(*p, end);
+  if ((size_t)(end - *p) <= len || strncmp(*p, key, len) != 0 || (*p)[len] != ' ')
+  {
+    return false;
+  }
+  char *after;
+  *value = strtol(*p + len, &after, 10);
+  if (after == *p + len)
+  {
+    return false;
+  }
+  *p = after;
+  return true;
+}
+
+/// @brief reads a building map file into memory
+/// @param path the path of the map file
+/// @param map double pointer to which the new map will be stored
+/// @return 0 on success, otherwise -1 if the file could not be read or is malformed
+int loadMap(const char *path, BuildingMap **map)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size < 0)
+  {
+    fclose(f);
+    return -1;
+  }
+
+  // read the whole file in one go and parse it in place, terminated so strtol cannot run off the end
+  char *buf = malloc(size + 1);
+  if (fread(buf, 1, size, f) != (size_t)size)
+  {
+    free(buf);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  buf[size] = '\0';
+  char *p = buf;
+  char *end = buf + size;
+
+  BuildingMap *m = calloc(1, sizeof(BuildingMap));
+  long count;
+  if (!readKeyed(&p, end, "rooms", &count) || count <= 0 || count > INT_MAX)
+  {
+    goto fail;
+  }
+  m->roomCount = (int)count;
+  m->names = calloc(m->roomCount, MAX_STR);
+  p = nextLine(p, end);
+  for (int i = 0; i < m->roomCount; i++)
+  {
+    p = skipBlank(p, end);
+    if (p == end)
+    {
+      goto fail;
+    }
+    char *eol = p;
+    while (eol < end && *eol != '\n' && *eol != '\r')
+    {
+      eol++;
+    }
+    size_t len = eol - p;
+    if (len >= MAX_STR)
+    {
+      len = MAX_STR - 1;
+    }
+    memcpy(m->names[i], p, len);
+    p = eol;
+  }
+
+  if (!readKeyed(&p, end, "edges", &count) || count < 0 || count > INT_MAX)
+  {
+    goto fail;
+  }
+  m->edgeCount = (int)count;
+  m->edges = calloc(m->edgeCount > 0 ? m->edgeCount : 1, sizeof(int[2]));
+  for (int i = 0; i < m->edgeCount; i++)
+  {
+    for (int j = 0; j < 2; j++)
+    {
+      char *after;
+      long room = strtol(p, &after, 10);
+      if (after == p || room < 0 || room >= m->roomCount)
+      {
+        goto fail;
+      }
+      m->edges[i][j] = (int)room;
+      p = after;
+    }
+  }
+
+  m->spawn = 0;
+  if (readKeyed(&p, end, "spawn", &count))
+  {
+    if (count < 0 || count >= m->roomCount)
+    {
+      goto fail;
+    }
+    m->spawn = (int)count;
+  }
+
+  free(buf);
+  *map = m;
+  return 0;
+
+fail:
+  free(buf);
+  cleanupMap(m);
+  return -1;
+}
+
+/// @brief frees a building map
+/// @param map the map being free'd
+void cleanupMap(BuildingMap *map)
+{
+  free(map->names);
+  free(map->edges);
+  free(map);
+}
+
+/// @brief populate building with the rooms and connections of a map, in time linear in the size of the map
+/// @param building building to be populated
+/// @param map the map the building is built from
+void buildFromMap(BuildingType *building, BuildingMap *map)
+{
+  // the rooms are numbered by their place in the map so each edge is found in constant time
+  initRooms(building, map->roomCount);
+  building->names = malloc(map->roomCount * sizeof(building->names[0]));
+  memcpy(building->names, map->names, map->roomCount * sizeof(building->names[0]));
+  for (int i = 0; i < map->roomCount; i++)
+  {
+    initRoom(building->names[i], i, &building->rooms[i]);
+  }
+
+  buildAdjacency(building, map->edges, map->edgeCount);
+  building->spawn = building->roomIndex[map->spawn];
+}
@@ -0,0 +1,255 @@
+#include "defs.h"
+
+/*
+    Runtime metrics, only built with -DSIM_METRICS. Every thread counts
+    into its own ThreadMetrics, registered on first use, so the hooks in
+    the step functions never share a cache line or take a lock. The
+    threads are merged when printMetrics runs, once the hunt or batch is
+    over and every worker has been joined.
+
+    A step is timed from before the entity acts to after its next delay
+    is drawn, and filed under the last action it recorded. The room an
+    entity ends its step in is charged the delay it then sleeps there,
+    which gives occupancy in hunt seconds in both the real time and the
+    discrete modes.
+*/
+
+#ifdef SIM_METRICS
+
+static _Thread_local ThreadMetrics *myMetrics = NULL;
+static ThreadMetrics *allMetrics = NULL;
+static pthread_mutex_t metricsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// only ever switched by the main thread
+static MetricPhase phase = PHASE_SETUP;
+static uint64_t phaseStart = 0;
+static double phaseTime[NUM_PHASES];
+
+static const char *actionNames[NUM_ACTIONS] = {"COLLECT", "STANDARD", "MOVE", "SHARE", "DROP", "IDLE", "EXIT"};
+static const char *phaseNames[NUM_PHASES] = {"SETUP", "HUNT", "REPORT"};
+
+/// @brief finds the counters of the calling thread, creating and registering them on first use
+/// @return the calling threads counters
+static ThreadMetrics *threadMetrics(void)
+{
+  if (myMetrics == NULL)
+  {
+    myMetrics = calloc(1, sizeof(ThreadMetrics));
+    myMetrics->action = ACTION_IDLE;
+    pthread_mutex_lock(&metricsMutex);
+    myMetrics->next = allMetrics;
+    allMetrics = myMetrics;
+    pthread_mutex_unlock(&metricsMutex);
+  }
+  return myMetrics;
+}
+
+/// @brief the log2 histogram bucket of a value, 0 holds 0 and 1, the last bucket everything too large for the rest
+/// @param v the value
+/// @return the bucket
+static int metricBucket(uint64_t v)
+{
+  int b = v == 0 ? 0 : 63 - __builtin_clzll(v);
+  return b < METRIC_BUCKETS ? b : METRIC_BUCKETS - 1;
+}
+
+/// @brief nanoseconds on the monotonic clock
+/// @return the time
+uint64_t metricClock(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/// @brief notes what the step being run on this thread did, the last action noted is the one the step counts as
+/// @param action what the entity did
+void recordAction(MetricAction action)
+{
+  threadMetrics()->action = action;
+}
+
+/// @brief counts a finished step under its action, along with its latency, the evidence in its room and the time it will sleep there
+/// @param started metricClock from before the step
+/// @param room the room the entity ended the step in
+/// @param active false if the entity left the hunt with this step
+/// @param delay seconds the entity sleeps before its next step
+void recordStep(uint64_t started, RoomType *room, bool active, double delay)
+{
+  uint64_t ns = metricClock() - started;
+  ThreadMetrics *m = threadMetrics();
+  MetricAction action = active ? m->action : ACTION_EXIT;
+  m->action = ACTION_IDLE;
+  m->actions[action]++;
+  m->actionNs[action] += ns;
+  m->latency[action][metricBucket(ns)]++;
+  // read without the room lock, it only needs to be about right
+  int held = room->evidenceCount;
+  m->evidence[held == 0 ? 0 : metricBucket(held) + (held < (1 << (METRIC_BUCKETS - 2)))]++;
+
+  if (room->id >= m->rooms)
+  {
+    int rooms = m->rooms == 0 ? 16 : m->rooms;
+    while (rooms <= room->id)
+    {
+      rooms *= 2;
+    }
+    m->occupancy = realloc(m->occupancy, rooms * sizeof(double));
+    memset(m->occupancy + m->rooms, 0, (rooms - m->rooms) * sizeof(double));
+    m->rooms = rooms;
+  }
+  if (active)
+  {
+    m->occupancy[room->id] += delay;
+  }
+}
+
+/// @brief counts a wait for a room lock
+/// @param ns nanoseconds spent waiting
+void recordLockWait(long ns)
+{
+  threadMetrics()->lockWaits[metricBucket(ns)]++;
+}
+
+/// @brief ends the current phase of the run and starts the next, only called from the main thread
+/// @param next the phase starting now
+void recordPhase(MetricPhase next)
+{
+  uint64_t now = metricClock();
+  if (phaseStart != 0)
+  {
+    phaseTime[phase] += (now - phaseStart) / 1e9;
+  }
+  phase = next;
+  phaseStart = now;
+}
+
+/// @brief the upper bound of the bucket a quantile of a histogram falls in
+/// @param h the histogram
+/// @param q the quantile, between 0 and 1
+/// @return the value below which at least q of the histogram lies
+static double histogramQuantile(long *h, double q)
+{
+  long total = 0;
+  for (int i = 0; i < METRIC_BUCKETS; i++)
+  {
+    total += h[i];
+  }
+  long seen = 0;
+  for (int i = 0; i < METRIC_BUCKETS; i++)
+  {
+    seen += h[i];
+    if (seen > 0 && seen >= q * total)
+    {
+      return (double)(2ULL << i);
+    }
+  }
+  return 0;
+}
+
+/// @brief merges the counters of every thread, prints them as summary tables and frees them, only call once every thread that stepped entities has finished
+void printMetrics(void)
+{
+  recordPhase(phase);
+
+  ThreadMetrics total;
+  memset(&total, 0, sizeof(total));
+  int threads = 0;
+  pthread_mutex_lock(&metricsMutex);
+  ThreadMetrics *m = allMetrics;
+  allMetrics = NULL;
+  pthread_mutex_unlock(&metricsMutex);
+  while (m != NULL)
+  {
+    for (int a = 0; a < NUM_ACTIONS; a++)
+    {
+      total.actions[a] += m->actions[a];
+      total.actionNs[a] += m->actionNs[a];
+      for (int i = 0; i < METRIC_BUCKETS; i++)
+      {
+        total.latency[a][i] += m->latency[a][i];
+      }
+    }
+    for (int i = 0; i < METRIC_BUCKETS; i++)
+    {
+      total.lockWaits[i] += m->lockWaits[i];
+      total.evidence[i] += m->evidence[i];
+    }
+    if (m->rooms > total.rooms)
+    {
+      total.occupancy = realloc(total.occupancy, m->rooms * sizeof(double));
+      memset(total.occupancy + total.rooms, 0, (m->rooms - total.rooms) * sizeof(double));
+      total.rooms = m->rooms;
+    }
+    for (int i = 0; i < m->rooms; i++)
+    {
+      total.occupancy[i] += m->occupancy[i];
+    }
+    ThreadMetrics *temp = m;
+    m = m->next;
+    free(temp->occupancy);
+    free(temp);
+    threads++;
+  }
+  // the calling thread registers again if it steps anything later
+  myMetrics = NULL;
+
+  printf("\nMETRICS FROM %d THREADS\n", threads);
+  printf("%-10s %12s\n", "PHASE", "SECONDS");
+  for (int p = 0; p < NUM_PHASES; p++)
+  {
+    printf("%-10s %12.3f\n", phaseNames[p], phaseTime[p]);
+  }
+
+  printf("\n%-10s %12s %12s %12s %12s\n", "ACTION", "COUNT", "MEAN (NS)", "P50 (NS)", "P99 (NS)");
+  for (int a = 0; a < NUM_ACTIONS; a++)
+  {
+    if (total.actions[a] > 0)
+    {
+      printf("%-10s %12ld %12.0f %12.0f %12.0f\n", actionNames[a], total.actions[a], (double)total.actionNs[a] / total.actions[a],
+             histogramQuantile(total.latency[a], 0.5), histogramQuantile(total.latency[a], 0.99));
+    }
+  }
+
+  long waits = 0;
+  for (int i = 0; i < METRIC_BUCKETS; i++)
+  {
+    waits += total.lockWaits[i];
+  }
+  printf("\nROOM LOCK WAITS: %ld, P50 %.0f NS, P99 %.0f NS\n", waits, histogramQuantile(total.lockWaits, 0.5), histogramQuantile(total.lockWaits, 0.99));
+
+  printf("\n%-14s %12s\n", "ROOM EVIDENCE", "STEPS");
+  for (int i = 0; i < METRIC_BUCKETS; i++)
+  {
+    if (total.evidence[i] > 0)
+    {
+      if (i <= 1)
+      {
+        printf("%-14d %12ld\n", i, total.evidence[i]);
+      }
+      else
+      {
+        char range[32];
+        snprintf(range, sizeof(range), "%llu-%llu", 1ULL << (i - 1), (2ULL << (i - 1)) - 1);
+        printf("%-14s %12ld\n", range, total.evidence[i]);
+      }
+    }
+  }
+
+  double occupied = 0;
+  for (int i = 0; i < total.rooms; i++)
+  {
+    occupied += total.occupancy[i];
+  }
+  printf("\n%-8s %14s %8s\n", "ROOM", "OCCUPIED (S)", "SHARE");
+  for (int i = 0; i < total.rooms; i++)
+  {
+    if (total.occupancy[i] > 0)
+    {
+      printf("%-8d %14.1f %7.1f%%\n", i, total.occupancy[i], 100 * total.occupancy[i] / occupied);
+    }
+  }
+  free(total.occupancy);
+}
+
+#endif
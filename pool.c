@@ -0,0 +1,336 @@
+#include "defs.h"
+
+/*
+    Work stealing worker pool. Hunters and ghosts are not given a thread
+    each; instead a fixed number of workers step them in real time.
+
+    Every worker owns a deque of entities that are ready to step and a
+    timer heap of entities sleeping until their wake up. A worker moves
+    whatever has woken up from its heap onto the back of its deque and
+    steps entities from the back. A worker with nothing ready steals
+    from the front of another workers deque, so a burst of wake ups on
+    one worker is spread over every idle one. After a step the entity
+    sleeps on the heap of the worker that stepped it, the same delay an
+    entity thread used to sleep for.
+
+    An entity is only ever in one deque or heap, so no two workers step
+    it at once. Workers stop once every entity has left the hunt.
+
+    Wake ups are in simulated seconds, and an entity wakes its delay
+    after the time it was due, not after its step finished, so a slow
+    step or a late wake up never pushes the rest of the hunt back. A
+    paced pool maps simulated time onto the wall clock at its speed (10
+    plays the hunt ten times as fast) and idle workers sleep until an
+    absolute deadline with clock_nanosleep. An unpaced pool never
+    sleeps: its clock only moves on once no entity is ready or being
+    stepped anywhere, and then jumps to the earliest wake up, so
+    entities step in the same order as they would in real time.
+*/
+
+/// @brief seconds since the pool was started, on the monotonic clock
+/// @param p the pool
+/// @return the wall clock of the pool
+static double poolWallTime(WorkerPool *p)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - p->start.tv_sec) + (now.tv_nsec - p->start.tv_nsec) / 1e9;
+}
+
+/// @brief the simulated time of the pool
+/// @param p the pool
+/// @return simulated seconds since the pool started
+static double poolTime(WorkerPool *p)
+{
+  if (p->speed == POOL_UNLIMITED)
+  {
+    return atomic_load(&p->now);
+  }
+  return poolWallTime(p) * p->speed;
+}
+
+/// @brief sleeps until a point on the wall clock of the pool, measured from when it started rather than from now so the wait can not drift
+/// @param p the pool
+/// @param wall seconds since the pool started
+static void sleepUntil(WorkerPool *p, double wall)
+{
+  struct timespec deadline = p->start;
+  deadline.tv_sec += (time_t)wall;
+  deadline.tv_nsec += (long)((wall - (time_t)wall) * 1e9);
+  if (deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+  {
+  }
+}
+
+/// @brief moves the clock of an unpaced pool on to the earliest wake up, only once no entity is ready or being stepped on any worker
+/// @param p the pool
+static void advanceClock(WorkerPool *p)
+{
+  long wakeups = atomic_load(&p->wakeups);
+  if (atomic_load(&p->pending) > 0)
+  {
+    return;
+  }
+  double next = INFINITY;
+  for (int i = 0; i < p->count; i++)
+  {
+    double wake = atomic_load(&p->workers[i].nextWake);
+    next = wake < next ? wake : next;
+  }
+  // an entity woken up meanwhile may have been taken off a heap after it was read
+  if (next == INFINITY || atomic_load(&p->pending) > 0 || atomic_load(&p->wakeups) != wakeups)
+  {
+    return;
+  }
+  double now = atomic_load(&p->now);
+  while (next > now && !atomic_compare_exchange_weak(&p->now, &now, next))
+  {
+  }
+}
+
+/// @brief publishes the first wake up on a workers timer heap for advanceClock
+/// @param w the worker
+static void publishWake(PoolWorker *w)
+{
+  atomic_store(&w->nextWake, w->timers->size > 0 ? w->timers->heap[0].time : INFINITY);
+}
+
+/// @brief adds an entity to the back of a workers ready deque, growing it when full
+/// @param w the worker
+/// @param task the entity
+static void pushReady(PoolWorker *w, SimEvent *task)
+{
+  pthread_mutex_lock(&w->lock);
+  if (w->count == w->capacity)
+  {
+    // unwrap the ring into the front of a buffer twice the size
+    SimEvent *grown = malloc(w->capacity * 2 * sizeof(SimEvent));
+    for (int i = 0; i < w->count; i++)
+    {
+      grown[i] = w->ready[(w->head + i) % w->capacity];
+    }
+    free(w->ready);
+    w->ready = grown;
+    w->head = 0;
+    w->capacity *= 2;
+  }
+  w->ready[(w->head + w->count) % w->capacity] = *task;
+  w->count++;
+  pthread_mutex_unlock(&w->lock);
+}
+
+/// @brief takes the entity at the back of a workers own ready deque
+/// @param w the worker
+/// @param task where the entity is stored
+/// @return false if the deque was empty
+static bool popReady(PoolWorker *w, SimEvent *task)
+{
+  pthread_mutex_lock(&w->lock);
+  bool found = w->count > 0;
+  if (found)
+  {
+    w->count--;
+    *task = w->ready[(w->head + w->count) % w->capacity];
+  }
+  pthread_mutex_unlock(&w->lock);
+  return found;
+}
+
+/// @brief takes the entity at the front of the ready deque of another worker, trying each once starting from a random one
+/// @param w the worker looking for work
+/// @param task where the entity is stored
+/// @return false if every other deque was empty
+static bool stealTask(PoolWorker *w, SimEvent *task)
+{
+  WorkerPool *p = w->pool;
+  if (p->count < 2)
+  {
+    return false;
+  }
+  int first = randInt(&w->rng, 0, p->count);
+  for (int i = 0; i < p->count; i++)
+  {
+    PoolWorker *victim = &p->workers[(first + i) % p->count];
+    if (victim == w)
+    {
+      continue;
+    }
+    pthread_mutex_lock(&victim->lock);
+    bool found = victim->count > 0;
+    if (found)
+    {
+      *task = victim->ready[victim->head];
+      victim->head = (victim->head + 1) % victim->capacity;
+      victim->count--;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    if (found)
+    {
+      w->steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/// @brief steps an entity and puts it to sleep on the workers timer heap, or retires it once it has left the hunt
+/// @param w the worker running the entity
+/// @param task the entity
+static void runTask(PoolWorker *w, SimEvent *task)
+{
+  double delay;
+  w->steps++;
+  w->last = task->time > w->last ? task->time : w->last;
+  if (stepEntity(task->kind, task->entity, &delay))
+  {
+    scheduleEvent(w->timers, task->time + delay, task->kind, task->entity);
+    publishWake(w);
+  }
+  else
+  {
+    atomic_fetch_sub(&w->pool->active, 1);
+  }
+  atomic_fetch_sub(&w->pool->pending, 1);
+}
+
+/// @brief worker thread, steps its own and stolen entities until every entity has left the hunt
+/// @param arg void pointer, will be typecasted to a PoolWorker
+static void *poolWorker(void *arg)
+{
+  PoolWorker *w = (PoolWorker *)arg;
+  WorkerPool *p = w->pool;
+  SimEvent task;
+  while (atomic_load(&p->active) > 0)
+  {
+    double now = poolTime(p);
+    // everything that has woken up goes where idle workers can steal it
+    if (w->timers->size > 0 && w->timers->heap[0].time <= now)
+    {
+      while (w->timers->size > 0 && w->timers->heap[0].time <= now)
+      {
+        atomic_fetch_add(&p->pending, 1);
+        atomic_fetch_add(&p->wakeups, 1);
+        popEvent(w->timers, &task);
+        pushReady(w, &task);
+      }
+      publishWake(w);
+    }
+
+    if (popReady(w, &task) || stealTask(w, &task))
+    {
+      runTask(w, &task);
+      continue;
+    }
+
+    if (p->speed == POOL_UNLIMITED)
+    {
+      advanceClock(p);
+      sched_yield();
+      continue;
+    }
+
+    // nothing to run, sleep until the next own wake up but look for work to steal again soon
+    double wall = poolWallTime(p);
+    double until = wall + POOL_IDLE;
+    if (w->timers->size > 0 && w->timers->heap[0].time / p->speed < until)
+    {
+      until = w->timers->heap[0].time / p->speed;
+    }
+    sleepUntil(p, until);
+  }
+  return NULL;
+}
+
+/// @brief creates a pool of workers and deals every hunter and ghost of a building out to them, ready to step at once
+/// @param pool double pointer to store the new pool
+/// @param b the building, every entity must already be in it
+/// @param threads the number of workers, 0 uses one per online core
+/// @param speed simulated seconds per second, POOL_UNLIMITED to run as fast as possible
+void initWorkerPool(WorkerPool **pool, BuildingType *b, int threads, double speed)
+{
+  if (threads <= 0)
+  {
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+    {
+      threads = 1;
+    }
+  }
+
+  WorkerPool *p = calloc(1, sizeof(WorkerPool));
+  p->count = threads;
+  p->workers = calloc(threads, sizeof(PoolWorker));
+  atomic_init(&p->active, b->noteBook->count + b->ghostCount);
+  // every entity starts out ready
+  atomic_init(&p->pending, b->noteBook->count + b->ghostCount);
+  atomic_init(&p->wakeups, 0);
+  atomic_init(&p->now, 0.0);
+  p->speed = speed;
+  for (int i = 0; i < threads; i++)
+  {
+    PoolWorker *w = &p->workers[i];
+    w->pool = p;
+    pthread_mutex_init(&w->lock, NULL);
+    w->capacity = 16;
+    w->ready = malloc(w->capacity * sizeof(SimEvent));
+    w->head = 0;
+    w->count = 0;
+    initScheduler(&w->timers);
+    atomic_init(&w->nextWake, INFINITY);
+    splitRand(&b->rng, &w->rng);
+  }
+
+  // deal entities out in turn, stealing evens out whatever this gets wrong
+  int next = 0;
+  for (int i = 0; i < b->noteBook->count; i++)
+  {
+    SimEvent task = {0, 0, HUNTER_ENTITY, b->noteBook->hunters[i]};
+    pushReady(&p->workers[next++ % threads], &task);
+  }
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    SimEvent task = {0, 0, GHOST_ENTITY, b->ghosts[i]};
+    pushReady(&p->workers[next++ % threads], &task);
+  }
+  *pool = p;
+}
+
+/// @brief runs the hunt, returning once every hunter and ghost has left
+/// @param p the pool
+void runWorkerPool(WorkerPool *p)
+{
+  clock_gettime(CLOCK_MONOTONIC, &p->start);
+  for (int i = 0; i < p->count; i++)
+  {
+    pthread_create(&p->workers[i].thread, NULL, poolWorker, &p->workers[i]);
+  }
+  for (int i = 0; i < p->count; i++)
+  {
+    pthread_join(p->workers[i].thread, NULL);
+  }
+  p->elapsed = poolWallTime(p);
+  p->simulated = 0;
+  for (int i = 0; i < p->count; i++)
+  {
+    p->simulated = p->workers[i].last > p->simulated ? p->workers[i].last : p->simulated;
+  }
+}
+
+/// @brief frees the pool and its workers, the entities are not touched
+/// @param p the pool being free'd
+void cleanupWorkerPool(WorkerPool *p)
+{
+  for (int i = 0; i < p->count; i++)
+  {
+    pthread_mutex_destroy(&p->workers[i].lock);
+    free(p->workers[i].ready);
+    cleanupScheduler(p->workers[i].timers);
+  }
+  free(p->workers);
+  free(p);
+}
@@ -0,0 +1,869 @@
+#include "defs.h"
+
+/*
+    Trace replay. loadReplay reads a whole trace into memory, rebuilds
+    the building, hunters and ghosts from its header and merges the
+    events of every writer by time.
+
+    A first pass then works out which piece of evidence every drop,
+    reading, collection and share is about, without touching the
+    building. Evidence is numbered in the order it is created, a hunters
+    collection only ever grows and hunters always take the oldest
+    evidence from a bucket, so the whole state of a hunt at any point is
+    a handful of counters into those histories. The pass saves the
+    counters as a keyframe every REPLAY_KEYFRAME_INTERVAL events.
+
+    stepReplay redoes the next event on the building through the same
+    functions the hunt used. seekReplay rebuilds the building from the
+    last keyframe at or before the target and steps the rest of the way.
+*/
+
+/// @brief reads an unsigned LEB128 varint
+/// @param in the reader
+/// @return the value, 0 if the trace ends first
+static uint64_t readVarint(TraceReader *in)
+{
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64 && in->pos < in->size; shift += 7)
+  {
+    unsigned char c = in->data[in->pos++];
+    v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+    {
+      return v;
+    }
+  }
+  in->bad = true;
+  return 0;
+}
+
+/// @brief reads raw bytes
+/// @param in the reader
+/// @param out where the bytes are copied, zeroed if the trace ends first
+/// @param n the number of bytes
+static void readBytes(TraceReader *in, void *out, size_t n)
+{
+  if (in->size - in->pos < n)
+  {
+    memset(out, 0, n);
+    in->pos = in->size;
+    in->bad = true;
+    return;
+  }
+  memcpy(out, in->data + in->pos, n);
+  in->pos += n;
+}
+
+/// @brief reads a single byte
+/// @param in the reader
+/// @return the byte
+static unsigned char readByte(TraceReader *in)
+{
+  unsigned char c;
+  readBytes(in, &c, 1);
+  return c;
+}
+
+/// @brief reads a length prefixed name, cutting it down to fit if needed
+/// @param in the reader
+/// @param name where the name is stored, MAX_STR long
+static void readName(TraceReader *in, char *name)
+{
+  size_t len = readByte(in);
+  if (in->size - in->pos < len)
+  {
+    in->bad = true;
+    len = in->size - in->pos;
+  }
+  size_t keep = len < MAX_STR - 1 ? len : MAX_STR - 1;
+  memcpy(name, in->data + in->pos, keep);
+  name[keep] = '\0';
+  in->pos += len;
+}
+
+/// @brief reads the header of a trace and builds the building, hunters and ghosts it describes
+/// @param r the replay being loaded
+/// @param in the reader, at the start of the file
+/// @return 0 on success, otherwise -1 if the header is damaged or describes a hunt this build cannot run
+static int readHeader(Replay *r, TraceReader *in)
+{
+  char magic[4];
+  readBytes(in, magic, 4);
+  if (memcmp(magic, TRACE_MAGIC, 4) != 0 || readByte(in) != TRACE_VERSION)
+  {
+    return -1;
+  }
+  uint64_t seed;
+  readBytes(in, &seed, sizeof(seed));
+
+  // every room name and edge takes at least a byte, so a count bigger than the file is damage
+  uint64_t rooms = readVarint(in);
+  if (in->bad || rooms == 0 || rooms > in->size - in->pos)
+  {
+    return -1;
+  }
+  BuildingMap *map = calloc(1, sizeof(BuildingMap));
+  map->roomCount = (int)rooms;
+  map->names = malloc(rooms * sizeof(*map->names));
+  for (int i = 0; i < map->roomCount; i++)
+  {
+    readName(in, map->names[i]);
+  }
+  uint64_t edges = readVarint(in);
+  if (in->bad || edges > (in->size - in->pos) / 2)
+  {
+    cleanupMap(map);
+    return -1;
+  }
+  map->edgeCount = (int)edges;
+  map->edges = malloc((edges + 1) * sizeof(*map->edges));
+  for (int i = 0; i < map->edgeCount; i++)
+  {
+    uint64_t a = readVarint(in);
+    uint64_t c = readVarint(in);
+    if (a >= rooms || c >= rooms)
+    {
+      in->bad = true;
+    }
+    map->edges[i][0] = (int)a;
+    map->edges[i][1] = (int)c;
+  }
+  uint64_t spawn = readVarint(in);
+  map->spawn = (int)spawn;
+
+  // every hunter takes at least two bytes
+  uint64_t hunters = readVarint(in);
+  if (in->bad || hunters > (in->size - in->pos) / 2)
+  {
+    cleanupMap(map);
+    return -1;
+  }
+  char (*names)[MAX_STR] = malloc((hunters + 1) * sizeof(*names));
+  int *equipment = malloc((hunters + 1) * sizeof(int));
+  for (uint64_t i = 0; i < hunters; i++)
+  {
+    readName(in, names[i]);
+    equipment[i] = readByte(in);
+    if (equipment[i] >= NUM_EVIDENCE_TYPES)
+    {
+      in->bad = true;
+    }
+  }
+  // every ghost takes at least two bytes too
+  uint64_t ghosts = readVarint(in);
+  if (in->bad || ghosts > (in->size - in->pos) / 2)
+  {
+    in->bad = true;
+    ghosts = 0;
+  }
+  int *ghostTypes = malloc((ghosts + 1) * sizeof(int));
+  int *ghostRooms = malloc((ghosts + 1) * sizeof(int));
+  for (uint64_t i = 0; i < ghosts; i++)
+  {
+    ghostTypes[i] = readByte(in);
+    uint64_t room = readVarint(in);
+    if (ghostTypes[i] >= NUM_GHOST_TYPES || room >= rooms)
+    {
+      in->bad = true;
+    }
+    ghostRooms[i] = (int)room;
+  }
+  if (in->bad || spawn >= rooms)
+  {
+    free(names);
+    free(equipment);
+    free(ghostTypes);
+    free(ghostRooms);
+    cleanupMap(map);
+    return -1;
+  }
+
+  BuildingType *b = NULL;
+  initBuilding(&b, seed);
+  buildFromMap(b, map);
+  cleanupMap(map);
+  r->hunterCount = (int)hunters;
+  r->ghostCount = (int)ghosts;
+  r->entityCount = r->hunterCount + r->ghostCount;
+  r->hunters = malloc((hunters + 1) * sizeof(HunterType *));
+  for (int i = 0; i < r->hunterCount; i++)
+  {
+    initHunter(names[i], equipment[i], b, &r->hunters[i]);
+  }
+  free(names);
+  free(equipment);
+  for (int i = 0; i < r->ghostCount; i++)
+  {
+    GhostType *g = NULL;
+    initGhost(b, &g);
+    g->type = ghostTypes[i];
+    updateGhostRoom(g, b->roomIndex[ghostRooms[i]]);
+  }
+  free(ghostTypes);
+  free(ghostRooms);
+
+  r->building = b;
+  r->exits = calloc(r->entityCount, sizeof(int));
+  return 0;
+}
+
+/// @brief orders events by time, then by writer, then by where they were in the file
+static int compareEvents(const void *a, const void *b)
+{
+  const ReplayEvent *x = a;
+  const ReplayEvent *y = b;
+  if (x->time != y->time)
+  {
+    return x->time < y->time ? -1 : 1;
+  }
+  if (x->writer != y->writer)
+  {
+    return x->writer < y->writer ? -1 : 1;
+  }
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/// @brief decodes every chunk after the header, checks each event makes sense for the building and merges the writers by time
+/// @param r the replay being loaded, its building already built
+/// @param in the reader, just past the header
+/// @return 0 on success, otherwise -1 if a chunk is damaged or an event refers to something that does not exist
+static int readEvents(Replay *r, TraceReader *in)
+{
+  long capacity = 1024;
+  r->events = malloc(capacity * sizeof(ReplayEvent));
+  r->eventCount = 0;
+  bool sorted = true;
+
+  while (in->pos < in->size)
+  {
+    uint32_t length;
+    readBytes(in, &length, sizeof(length));
+    int writer = (int)readVarint(in);
+    uint64_t time = readVarint(in);
+    if (in->bad || length > in->size - in->pos)
+    {
+      return -1;
+    }
+    size_t end = in->pos + length;
+
+    while (in->pos < end)
+    {
+      if (r->eventCount == capacity)
+      {
+        capacity *= 2;
+        r->events = realloc(r->events, capacity * sizeof(ReplayEvent));
+      }
+      ReplayEvent *ev = &r->events[r->eventCount];
+      ev->op = readByte(in);
+      time += readVarint(in);
+      ev->time = time;
+      ev->entity = (int)readVarint(in);
+      ev->writer = writer;
+      ev->seq = r->eventCount;
+      ev->evidence = -1;
+      ev->arg = 0;
+      ev->type = 0;
+      ev->value = 0;
+
+      bool isHunter = ev->entity >= 0 && ev->entity < r->hunterCount;
+      bool isGhost = ev->entity >= r->hunterCount && ev->entity < r->entityCount;
+      bool ok = isHunter || isGhost;
+      switch (ev->op)
+      {
+      case TRACE_MOVE:
+        ev->arg = (int)readVarint(in);
+        ok = ok && ev->arg >= 0 && ev->arg < r->building->roomCount;
+        break;
+      case TRACE_DROP:
+        ev->type = readByte(in);
+        readBytes(in, &ev->value, sizeof(float));
+        ok = isGhost && ev->type < NUM_EVIDENCE_TYPES;
+        break;
+      case TRACE_STANDARD:
+        readBytes(in, &ev->value, sizeof(float));
+        ok = isHunter;
+        break;
+      case TRACE_COLLECT:
+        ok = isHunter;
+        break;
+      case TRACE_SHARE:
+        ev->arg = (int)readVarint(in);
+        ok = isHunter && ev->arg >= 0 && ev->arg < r->hunterCount;
+        break;
+      case TRACE_FEAR:
+        ev->arg = (int)readVarint(in);
+        ok = isHunter;
+        break;
+      case TRACE_EXIT:
+        ev->arg = readByte(in);
+        ok = ok && ev->arg <= EXIT_FOUND;
+        break;
+      default:
+        ok = false;
+      }
+      if (!ok || in->bad || in->pos > end)
+      {
+        return -1;
+      }
+      if (r->eventCount > 0 && compareEvents(ev - 1, ev) > 0)
+      {
+        sorted = false;
+      }
+      r->eventCount++;
+    }
+  }
+
+  // a trace recorded on one thread is already in order
+  if (!sorted)
+  {
+    qsort(r->events, r->eventCount, sizeof(ReplayEvent), compareEvents);
+  }
+  return 0;
+}
+
+/// @brief the type of a piece of evidence, read from the event that created it
+/// @param r the replay
+/// @param id the evidence
+/// @return its type
+static EvidenceClassType evidenceTypeOf(Replay *r, long id)
+{
+  ReplayEvent *ev = &r->events[r->created[id]];
+  return ev->op == TRACE_DROP ? (EvidenceClassType)ev->type : r->hunters[ev->entity]->equipment;
+}
+
+/// @brief whether a piece of evidence is ghostly, read from the event that created it
+/// @param r the replay
+/// @param id the evidence
+/// @return true if it is ghostly
+static bool evidenceIsGhostly(Replay *r, long id)
+{
+  EvidenceType probe = {0};
+  probe.type = evidenceTypeOf(r, id);
+  probe.value = r->events[r->created[id]].value;
+  return isGhostly(&probe);
+}
+
+/// @brief appends evidence to a hunters history
+/// @param h the history
+/// @param id the evidence
+static void pushHistory(ReplayHistory *h, long id)
+{
+  if (h->count == h->capacity)
+  {
+    h->capacity = h->capacity == 0 ? 64 : h->capacity * 2;
+    h->items = realloc(h->items, h->capacity * sizeof(long));
+  }
+  h->items[h->count++] = id;
+}
+
+/// @brief saves the counters of the first pass as a keyframe
+/// @param r the replay
+/// @param position the number of events applied so far
+/// @param rooms room of every entity
+/// @param fears fear of every hunter
+/// @param known the known bits of every hunter
+/// @param heads evidence collected from every bucket
+/// @param dropped evidence every ghost has dropped
+static void saveKeyframe(Replay *r, long position, int *rooms, int *fears, unsigned *known, long *heads, int *dropped)
+{
+  ReplayKeyframe *kf = &r->keyframes[r->keyframeCount++];
+  kf->position = position;
+  kf->evidenceCount = r->evidenceCount;
+  kf->rooms = malloc(r->entityCount * sizeof(int));
+  memcpy(kf->rooms, rooms, r->entityCount * sizeof(int));
+  kf->fears = malloc((r->hunterCount + 1) * sizeof(int));
+  memcpy(kf->fears, fears, r->hunterCount * sizeof(int));
+  kf->known = malloc((r->hunterCount + 1) * sizeof(unsigned));
+  memcpy(kf->known, known, r->hunterCount * sizeof(unsigned));
+  kf->exits = malloc(r->entityCount * sizeof(int));
+  memcpy(kf->exits, r->exits, r->entityCount * sizeof(int));
+  kf->lengths = malloc((r->hunterCount + 1) * sizeof(long));
+  for (int i = 0; i < r->hunterCount; i++)
+  {
+    kf->lengths[i] = r->histories[i].count;
+  }
+  kf->bucketCount = r->bucketCount;
+  kf->heads = malloc((r->bucketCount + 1) * sizeof(long));
+  kf->tails = malloc((r->bucketCount + 1) * sizeof(long));
+  for (int i = 0; i < r->bucketCount; i++)
+  {
+    kf->heads[i] = heads[i];
+    kf->tails[i] = r->buckets[i].count;
+  }
+  kf->dropped = malloc((r->ghostCount + 1) * sizeof(int));
+  memcpy(kf->dropped, dropped, r->ghostCount * sizeof(int));
+}
+
+/// @brief the first pass, follows every piece of evidence through the hunt and saves the keyframes, the building is left untouched
+/// @param r the replay, its events already read
+static void resolveEvents(Replay *r)
+{
+  BuildingType *b = r->building;
+  int *rooms = malloc(r->entityCount * sizeof(int));
+  int *fears = malloc((r->hunterCount + 1) * sizeof(int));
+  unsigned *known = calloc(r->hunterCount + 1, sizeof(unsigned));
+  for (int i = 0; i < r->hunterCount; i++)
+  {
+    rooms[i] = r->hunters[i]->room->id;
+    fears[i] = 0;
+  }
+  int *dropped = calloc(r->ghostCount + 1, sizeof(int));
+  for (int i = 0; i < r->ghostCount; i++)
+  {
+    rooms[r->hunterCount + i] = b->ghosts[i]->room->id;
+  }
+
+  // buckets are only made once something is dropped into them, bucketOf maps [room][type][ghostly] to one
+  int *bucketOf = malloc((size_t)b->roomCount * NUM_EVIDENCE_TYPES * 2 * sizeof(int));
+  memset(bucketOf, -1, (size_t)b->roomCount * NUM_EVIDENCE_TYPES * 2 * sizeof(int));
+  int bucketCapacity = 16;
+  r->buckets = calloc(bucketCapacity, sizeof(ReplayBucket));
+  long *heads = calloc(bucketCapacity, sizeof(long));
+  long evidenceCapacity = 1024;
+  r->created = malloc(evidenceCapacity * sizeof(long));
+  r->histories = calloc(r->hunterCount + 1, sizeof(ReplayHistory));
+  r->keyframes = malloc((r->eventCount / REPLAY_KEYFRAME_INTERVAL + 1) * sizeof(ReplayKeyframe));
+
+  for (long i = 0;; i++)
+  {
+    if (i % REPLAY_KEYFRAME_INTERVAL == 0)
+    {
+      saveKeyframe(r, i, rooms, fears, known, heads, dropped);
+    }
+    if (i == r->eventCount)
+    {
+      break;
+    }
+
+    ReplayEvent *ev = &r->events[i];
+    int h = ev->entity;
+    long id = -1;
+    if (ev->op == TRACE_DROP || ev->op == TRACE_STANDARD)
+    {
+      if (r->evidenceCount == evidenceCapacity)
+      {
+        evidenceCapacity *= 2;
+        r->created = realloc(r->created, evidenceCapacity * sizeof(long));
+      }
+      id = r->evidenceCount++;
+      r->created[id] = i;
+    }
+
+    switch (ev->op)
+    {
+    case TRACE_MOVE:
+      rooms[h] = ev->arg;
+      break;
+
+    case TRACE_DROP:
+    {
+      int key = (rooms[h] * NUM_EVIDENCE_TYPES + ev->type) * 2 + evidenceIsGhostly(r, id);
+      if (bucketOf[key] < 0)
+      {
+        if (r->bucketCount == bucketCapacity)
+        {
+          bucketCapacity *= 2;
+          r->buckets = realloc(r->buckets, bucketCapacity * sizeof(ReplayBucket));
+          heads = realloc(heads, bucketCapacity * sizeof(long));
+        }
+        ReplayBucket *nb = &r->buckets[r->bucketCount];
+        memset(nb, 0, sizeof(ReplayBucket));
+        nb->room = rooms[h];
+        nb->type = ev->type;
+        nb->ghostly = key & 1;
+        heads[r->bucketCount] = 0;
+        bucketOf[key] = r->bucketCount++;
+      }
+      ReplayBucket *bucket = &r->buckets[bucketOf[key]];
+      if (bucket->count == bucket->capacity)
+      {
+        bucket->capacity = bucket->capacity == 0 ? 16 : bucket->capacity * 2;
+        bucket->items = realloc(bucket->items, bucket->capacity * sizeof(long));
+      }
+      bucket->items[bucket->count++] = id;
+      dropped[h - r->hunterCount]++;
+      break;
+    }
+
+    case TRACE_STANDARD:
+      if (evidenceIsGhostly(r, id))
+      {
+        known[h] |= 1u << evidenceTypeOf(r, id);
+      }
+      break;
+
+    case TRACE_COLLECT:
+    {
+      int key = (rooms[h] * NUM_EVIDENCE_TYPES + r->hunters[h]->equipment) * 2 + 1;
+      int found = bucketOf[key];
+      if (found >= 0 && heads[found] < r->buckets[found].count)
+      {
+        id = r->buckets[found].items[heads[found]++];
+        known[h] |= 1u << evidenceTypeOf(r, id);
+      }
+      break;
+    }
+
+    case TRACE_SHARE:
+      known[ev->arg] |= known[h];
+      break;
+
+    case TRACE_FEAR:
+      fears[h] = ev->arg;
+      break;
+
+    case TRACE_EXIT:
+      r->exits[h] = ev->arg + 1;
+      break;
+    }
+
+    if (ev->op == TRACE_STANDARD || ev->op == TRACE_COLLECT)
+    {
+      if (id < 0)
+      {
+        // recorded on another thread within the same microsecond as what it depended on
+        r->skipped++;
+        continue;
+      }
+      pushHistory(&r->histories[h], id);
+    }
+    ev->evidence = id;
+  }
+
+  // the building starts at keyframe 0, which the first pass has moved past
+  memset(r->exits, 0, r->entityCount * sizeof(int));
+  free(heads);
+  free(bucketOf);
+  free(known);
+  free(dropped);
+  free(fears);
+  free(rooms);
+}
+
+/// @brief loads a trace and rebuilds the hunt it recorded, positioned before its first event
+/// @param path the trace file
+/// @param replay double pointer to store the new replay
+/// @return 0 on success, otherwise -1 if the file cannot be read or is not a trace this build can replay
+int loadReplay(const char *path, Replay **replay)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *data = malloc(size > 0 ? size : 1);
+  if (size < 0 || fread(data, 1, size, f) != (size_t)size)
+  {
+    free(data);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  Replay *r = calloc(1, sizeof(Replay));
+  TraceReader in = {data, (size_t)size, 0, false};
+  if (readHeader(r, &in) != 0)
+  {
+    free(data);
+    free(r);
+    return -1;
+  }
+  if (readEvents(r, &in) != 0)
+  {
+    free(data);
+    cleanupReplay(r);
+    return -1;
+  }
+  free(data);
+
+  resolveEvents(r);
+  r->evidence = calloc(r->evidenceCount + 1, sizeof(EvidenceType *));
+  r->position = 0;
+  *replay = r;
+  return 0;
+}
+
+/// @brief frees a replay along with the building it rebuilt
+/// @param r the replay being free'd
+void cleanupReplay(Replay *r)
+{
+  cleanupBuilding(r->building);
+  for (long i = 0; i < r->keyframeCount; i++)
+  {
+    ReplayKeyframe *kf = &r->keyframes[i];
+    free(kf->rooms);
+    free(kf->fears);
+    free(kf->known);
+    free(kf->exits);
+    free(kf->lengths);
+    free(kf->heads);
+    free(kf->tails);
+    free(kf->dropped);
+  }
+  free(r->keyframes);
+  if (r->histories != NULL)
+  {
+    for (int i = 0; i < r->hunterCount; i++)
+    {
+      free(r->histories[i].items);
+    }
+  }
+  free(r->histories);
+  for (int i = 0; i < r->bucketCount; i++)
+  {
+    free(r->buckets[i].items);
+  }
+  free(r->buckets);
+  free(r->created);
+  free(r->evidence);
+  free(r->events);
+  free(r->exits);
+  free(r->hunters);
+  free(r);
+}
+
+/// @brief matches an exit reason to the string it represents
+/// @param reason the reason an entity left
+/// @return the appropriate string it maps to
+static const char *exitEnumToStr(ExitReason reason)
+{
+  switch (reason)
+  {
+  case EXIT_BORED:
+    return "BORED";
+  case EXIT_SCARED:
+    return "SCARED";
+  case EXIT_FOUND:
+    return "FOUND ENOUGH EVIDENCE";
+  default:
+    return "THIS BAD";
+  }
+}
+
+/// @brief applies the next event of the trace to the building, through the same functions the hunt used
+/// @param r the replay
+/// @return true if an event was applied, false once the end of the trace is reached
+bool stepReplay(Replay *r)
+{
+  if (r->position >= r->eventCount)
+  {
+    return false;
+  }
+  ReplayEvent *ev = &r->events[r->position++];
+  BuildingType *b = r->building;
+  HunterType *hunter = ev->entity < r->hunterCount ? r->hunters[ev->entity] : NULL;
+  GhostType *ghost = hunter == NULL ? b->ghosts[ev->entity - r->hunterCount] : NULL;
+
+  switch (ev->op)
+  {
+  case TRACE_MOVE:
+    if (hunter != NULL)
+    {
+      updateHunterRoom(hunter, b->roomIndex[ev->arg]);
+      logEvent(LOG_INFO, "HUNTER: %s, HAS MOVED TO THIS ROOM %s\n", hunter->name, hunter->room->name);
+    }
+    else
+    {
+      updateGhostRoom(ghost, b->roomIndex[ev->arg]);
+      logEvent(LOG_INFO, "THE GHOST HAS MOVED TO: %s\n", ghost->room->name);
+    }
+    break;
+  case TRACE_DROP:
+    r->evidence[ev->evidence] = dropEvidence(ghost, ev->type, ev->value);
+    break;
+  case TRACE_STANDARD:
+    r->evidence[ev->evidence] = addStandardEvidence(hunter, ev->value);
+    break;
+  case TRACE_COLLECT:
+    collectEvidence(hunter);
+    break;
+  case TRACE_SHARE:
+    shareGhostlyEvidence(hunter, r->hunters[ev->arg]);
+    break;
+  case TRACE_FEAR:
+    hunter->building->table.fear[hunter->id] = ev->arg;
+    break;
+  case TRACE_EXIT:
+    r->exits[ev->entity] = ev->arg + 1;
+    logEvent(LOG_INFO, "%s HAS LEFT: %s\n", hunter != NULL ? hunter->name : ghostEnumToStr(ghost->type), exitEnumToStr(ev->arg));
+    break;
+  }
+  return true;
+}
+
+/// @brief throws away the dynamic state of the building and rebuilds it from a keyframe
+/// @param r the replay
+/// @param kf the keyframe
+static void restoreKeyframe(Replay *r, ReplayKeyframe *kf)
+{
+  BuildingType *b = r->building;
+
+  // every node and piece of evidence lives in an entity pool, so emptying those frees it all
+  for (int i = 0; i < r->bucketCount; i++)
+  {
+    RoomType *room = b->roomIndex[r->buckets[i].room];
+    room->evidence[r->buckets[i].type][r->buckets[i].ghostly].head = NULL;
+    room->evidence[r->buckets[i].type][r->buckets[i].ghostly].tail = NULL;
+    room->evidenceCount = 0;
+  }
+  for (int i = 0; i < r->hunterCount; i++)
+  {
+    HunterType *h = r->hunters[i];
+    removeHunter(h, &h->room->hunters);
+    h->evidence->head = NULL;
+    h->evidence->tail = NULL;
+    cleanupPool(h->pool);
+    initPool(&h->pool);
+  }
+  atomic_store_explicit(&b->table.team, 0, memory_order_relaxed);
+  for (int i = 0; i < r->ghostCount; i++)
+  {
+    GhostType *g = b->ghosts[i];
+    atomic_fetch_sub_explicit(&g->room->ghosts, 1, memory_order_relaxed);
+    cleanupPool(g->pool);
+    initPool(&g->pool);
+  }
+  cleanupEvidenceLog(b->evidence);
+  initEvidenceLog(&b->evidence);
+
+  for (long i = 0; i < kf->evidenceCount; i++)
+  {
+    ReplayEvent *ev = &r->events[r->created[i]];
+    EvidenceType *e = NULL;
+    if (ev->op == TRACE_DROP)
+    {
+      GhostType *g = b->ghosts[ev->entity - r->hunterCount];
+      initEvidence(g->pool, ev->type, ev->value, &e);
+      e->ghost = g;
+    }
+    else
+    {
+      HunterType *h = r->hunters[ev->entity];
+      initEvidence(h->pool, h->equipment, ev->value, &e);
+    }
+    appendEvidenceLog(b->evidence, e);
+    r->evidence[i] = e;
+  }
+
+  for (int i = 0; i < r->hunterCount; i++)
+  {
+    HunterType *h = r->hunters[i];
+    ReplayHistory *history = &r->histories[i];
+    h->room = b->roomIndex[kf->rooms[i]];
+    h->roomSlot = addHunter(h, &h->room->hunters);
+    b->table.room[h->id] = h->room;
+    b->table.fear[h->id] = kf->fears[i];
+    atomic_store_explicit(&b->table.known[h->id], kf->known[i], memory_order_relaxed);
+    atomic_fetch_or_explicit(&b->table.team, kf->known[i], memory_order_relaxed);
+    for (long j = 0; j < kf->lengths[i]; j++)
+    {
+      EvidenceNode *node = NULL;
+      initEvidenceNode(h->pool, r->evidence[history->items[j]], &node);
+      addEvidence(node, h->evidence);
+    }
+  }
+
+  for (int i = 0; i < r->ghostCount; i++)
+  {
+    GhostType *g = b->ghosts[i];
+    g->room = b->roomIndex[kf->rooms[r->hunterCount + i]];
+    b->table.room[g->id] = g->room;
+    atomic_fetch_add_explicit(&g->room->ghosts, 1, memory_order_relaxed);
+    g->evidenceDropped = kf->dropped[i];
+  }
+
+  for (int i = 0; i < kf->bucketCount; i++)
+  {
+    ReplayBucket *bucket = &r->buckets[i];
+    for (long j = kf->heads[i]; j < kf->tails[i]; j++)
+    {
+      EvidenceType *e = r->evidence[bucket->items[j]];
+      EvidenceNode *node = NULL;
+      initEvidenceNode(e->ghost->pool, e, &node);
+      addRoomEvidence(b->roomIndex[bucket->room], node);
+    }
+  }
+
+  memcpy(r->exits, kf->exits, r->entityCount * sizeof(int));
+  r->position = kf->position;
+}
+
+/// @brief moves the replay to just before an event, restoring the nearest keyframe when that is closer than stepping, nothing is logged on the way
+/// @param r the replay
+/// @param position the number of events that should have been applied, clamped to the length of the trace
+void seekReplay(Replay *r, long position)
+{
+  if (position < 0)
+  {
+    position = 0;
+  }
+  if (position > r->eventCount)
+  {
+    position = r->eventCount;
+  }
+
+  LogLevel level = logLevel;
+  logLevel = LOG_NONE;
+  ReplayKeyframe *kf = &r->keyframes[position / REPLAY_KEYFRAME_INTERVAL];
+  if (position < r->position || kf->position > r->position)
+  {
+    restoreKeyframe(r, kf);
+  }
+  while (r->position < position)
+  {
+    stepReplay(r);
+  }
+  logLevel = level;
+}
+
+/// @brief prints where every entity is, what it holds and which rooms have evidence left in them
+/// @param r the replay
+void printReplay(Replay *r)
+{
+  BuildingType *b = r->building;
+  double time = r->position > 0 ? r->events[r->position - 1].time / 1e6 : 0;
+  printf("EVENT %ld OF %ld AT %.6f SECONDS\n", r->position, r->eventCount, time);
+
+  for (int i = 0; i < r->hunterCount; i++)
+  {
+    HunterType *h = r->hunters[i];
+    long held = 0;
+    for (EvidenceNode *n = h->evidence->head; n != NULL; n = n->next)
+    {
+      held++;
+    }
+    printf("HUNTER: %s, IN THIS ROOM: %s, FEAR: %d, EVIDENCE: %ld, DIFFERENT GHOSTLY: %d", h->name, h->room->name, r->building->table.fear[h->id], held, knownKinds(r->building, h->id));
+    if (r->exits[i] != 0)
+    {
+      printf(", LEFT: %s", exitEnumToStr(r->exits[i] - 1));
+    }
+    printf("\n");
+  }
+
+  identifyGhosts(b);
+  for (int i = 0; i < r->ghostCount; i++)
+  {
+    GhostType *g = b->ghosts[i];
+    printf("GHOST: %s, IN THIS ROOM: %s, EVIDENCE DROPPED: %d, %s", ghostEnumToStr(g->type), g->room->name, g->evidenceDropped, g->identified ? "IDENTIFIED" : "NOT IDENTIFIED");
+    if (r->exits[r->hunterCount + i] != 0)
+    {
+      printf(", LEFT: %s", exitEnumToStr(r->exits[r->hunterCount + i] - 1));
+    }
+    printf("\n");
+  }
+
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    if (b->roomIndex[i]->evidenceCount > 0)
+    {
+      printf("ROOM: %s, EVIDENCE LEFT: %d\n", b->roomIndex[i]->name, b->roomIndex[i]->evidenceCount);
+    }
+  }
+  if (r->skipped > 0)
+  {
+    printf("%ld COLLECTIONS OR SHARES WERE RECORDED AT THE SAME MICROSECOND AS WHAT THEY DEPENDED ON AND FOUND NOTHING\n", r->skipped);
+  }
+}
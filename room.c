@@ -1,115 +1,121 @@
 #include "defs.h"
 
-/// @brief allocates memory for a room and initalizes all its fields
-/// @param name is the name of the room
+/// @brief initalizes all the fields of a room in the zeroed block of rooms of its building
+/// @param name is the name of the room, which must outlive it
+/// @param id is the number of the room
 /// @param room is the room being initalized
-void initRoom(char *name, RoomType **room)
+void initRoom(const char *name, int id, RoomType *room)
 {
-  *room = calloc(1, sizeof(RoomType));
+  room->name = name;
+  room->id = id;
 
-  strcpy((*room)->name, name);
+  // the evidence buckets and the roster are embedded and start out empty from calloc
+  room->evidenceCount = 0;
+  room->hunters.hunters = NULL;
+  room->hunters.count = 0;
+  room->hunters.capacity = 0;
+  atomic_init(&room->hunters.present, 0);
 
-  RoomList *r = NULL;
-  initRoomList(&r);
-  (*room)->rooms = r;
+  atomic_init(&room->ghosts, 0);
 
-  EvidenceList *e = NULL;
-  initEvidenceList(&e);
-  (*room)->evidence = e;
-
-  HunterNotebook *h = NULL;
-  initNotebook(&h);
-  (*room)->hunters = h;
-
-  (*room)->ghost = NULL;
-
-  sem_init(&((*room)->mutex), 0, 1);
+  sem_init(&room->mutex, 0, 1);
+  atomic_init(&room->locks, 0);
+  atomic_init(&room->lockWaits, 0);
+  atomic_init(&room->lockWaitNs, 0);
 }
 
-/// @brief cleans up all memory associated with a room
-/// @param room is the room being free'd
+/// @brief cleans up all memory associated with a room, the room itself belongs to the block of its building
+/// @param room is the room being cleaned up
 void cleanupRoom(RoomType *room)
 {
-  // dont free ghost here, free ghost when building is free'd since ghost is global to building
-  cleanupRoomNodes(room->rooms); // important to free the nodes and not the contents or else we enter an infinite loop
-  cleanupEvidenceNodes(room->evidence);
-  cleanupNotebook(room->hunters);
-  free(room);
+  // dont free ghosts here, free ghosts when building is free'd since ghosts are global to building
+  free(room->hunters.hunters);
+  sem_destroy(&room->mutex);
 }
 
-/// @brief initalizes a room node with some room data
-/// @param room is the room data for the node
-/// @param node is the node being initalized
-void initRoomNode(RoomType *room, RoomNode **node)
+/// @brief locks a room, blocking until no other entity holds it and counting the wait if it had to
+/// @param room is the room being locked
+void lockRoom(RoomType *room)
 {
-  *node = calloc(1, sizeof(RoomNode));
-  (*node)->next = NULL;
-  (*node)->prev = NULL;
-  (*node)->room = room;
-}
+  atomic_fetch_add_explicit(&room->locks, 1, memory_order_relaxed);
+  if (sem_trywait(&room->mutex) == 0)
+  {
+    return;
+  }
 
-/// @brief cleans up the node memory only for a given node
-/// @param node is the node being cleaned up here
-void cleanupRoomNode(RoomNode *node)
-{
-  // dont free the data here, we want to preserve it for the building list
-  free(node);
+  // only a contended lock pays for reading the clock
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (sem_wait(&room->mutex) != 0)
+  {
+    // interrupted by a signal, keep waiting
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+  atomic_fetch_add_explicit(&room->lockWaits, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&room->lockWaitNs, ns, memory_order_relaxed);
+  metricLockWait(ns);
 }
 
-/// @brief initalizes a room list and allocates memory for it
-/// @param l is the list being initalized
-void initRoomList(RoomList **l)
+/// @brief unlocks a room locked with lockRoom
+/// @param room is the room being unlocked
+void unlockRoom(RoomType *room)
 {
-  (*l) = calloc(1, sizeof(RoomList));
-  (*l)->head = NULL;
-  (*l)->tail = NULL;
+  sem_post(&room->mutex);
 }
 
-/// @brief cleans up all the nodes of a list, but not the data inside
-/// @param l is the list being free'd
-void cleanupRoomNodes(RoomList *l)
+/// @brief locks two rooms, always the lower numbered one first so two entities swapping rooms can never each hold the room the other is waiting on
+/// @param a is one of the rooms
+/// @param b is the other room, may be the same room as a
+void lockRooms(RoomType *a, RoomType *b)
 {
-  RoomNode *temp;
-  while (l->head != NULL)
+  if (a == b)
   {
-    temp = l->head;
-    l->head = l->head->next;
-    cleanupRoomNode(temp);
+    lockRoom(a);
+    return;
   }
-  free(l);
+  if (a->id > b->id)
+  {
+    RoomType *temp = a;
+    a = b;
+    b = temp;
+  }
+  lockRoom(a);
+  lockRoom(b);
 }
 
-/// @brief cleans up all the data associated with a room list, including the nodes and their data
-/// @param l is the list being free'd
-void cleanupRoomList(RoomList *l)
+/// @brief unlocks two rooms locked with lockRooms
+/// @param a is one of the rooms
+/// @param b is the other room, may be the same room as a
+void unlockRooms(RoomType *a, RoomType *b)
 {
-  RoomNode *temp;
-  while (l->head != NULL)
+  unlockRoom(a);
+  if (a != b)
   {
-    temp = l->head;
-    l->head = l->head->next;
-    cleanupRoom(temp->room);
-    cleanupRoomNode(temp);
+    unlockRoom(b);
   }
-  free(l);
 }
 
-/// @brief adds a room node to the end of a list
-/// @param node is the node being added
-/// @param l is the list being added to
-void appendRoom(RoomNode *node, RoomList *l)
+/// @brief prints how often the rooms of a building were locked and how long entities waited on them, only rooms that were ever waited on are listed
+/// @param b the building
+void printRoomLocks(BuildingType *b)
 {
-  if (l->head == NULL && l->tail == NULL)
-  {
-    l->head = node;
-    l->tail = node;
-  }
-  else
+  long locks = 0, waits = 0, waitNs = 0;
+  printf("\n%-20s %10s %10s %12s\n", "ROOM", "LOCKS", "WAITS", "WAITED (MS)");
+  for (int i = 0; i < b->roomCount; i++)
   {
-    l->tail->next = node;
-    node->prev = l->tail;
-    l->tail = node;
+    RoomType *r = b->roomIndex[i];
+    long roomWaits = atomic_load(&r->lockWaits);
+    long roomNs = atomic_load(&r->lockWaitNs);
+    locks += atomic_load(&r->locks);
+    waits += roomWaits;
+    waitNs += roomNs;
+    if (roomWaits > 0)
+    {
+      printf("%-20s %10ld %10ld %12.3f\n", r->name, atomic_load(&r->locks), roomWaits, roomNs / 1e6);
+    }
   }
+  printf("%-20s %10ld %10ld %12.3f\n", "TOTAL", locks, waits, waitNs / 1e6);
 }
 
 /// @brief helper for wether or not a room has a hunter
@@ -118,7 +124,8 @@ void appendRoom(RoomNode *node, RoomList *l)
 
 bool hasHunter(RoomType *room)
 {
-  return room->hunters->count > 0;
+  // ghosts check without the room lock, hunters may be coming or going meanwhile
+  return atomic_load_explicit(&room->hunters.present, memory_order_relaxed) > 0;
 }
 
 /// @brief helper for wether or not a room has multiple hunters
@@ -126,125 +133,84 @@ bool hasHunter(RoomType *room)
 /// @return returns true (1) if the room has hunters, otherwise false (0)
 bool hasHunters(RoomType *room)
 {
-  return room->hunters->count > 1;
+  return room->hunters.count > 1;
 }
 
-/// @brief helper for wether or not a room has the ghost
+/// @brief helper for wether or not a room has any ghost in it
 /// @param room is the room being checked
-/// @return returns true (1) if the room has the ghost, otherwise false (0)
+/// @return returns true (1) if the room has a ghost, otherwise false (0)
 bool hasGhost(RoomType *room)
 {
-  return room->ghost != NULL;
+  return atomic_load_explicit(&room->ghosts, memory_order_relaxed) > 0;
 }
 
-/// @brief copies the room data into another node
-/// @param e is the room whose data is being coppied
-/// @param node is the node being coppied to
-void copyRoom(RoomType *e, RoomNode **node)
+/// @brief finds a random room connected to the given room with a single lookup into the buildings adjacency
+/// @param b is the building the room is in
+/// @param room is the room whose neighbours are picked from
+/// @param rng is the generator of the entity doing the picking
+/// @return returns a roomtype pointer of the randomly selected room, or NULL if the room has no connections
+RoomType *findRandRoom(BuildingType *b, RoomType *room, RandState *rng)
 {
-  initRoomNode(e, node);
+  int start = b->adjOffset[room->id];
+  int size = b->adjOffset[room->id + 1] - start;
+  if (size == 0)
+  {
+    return NULL;
+  }
+  return b->roomIndex[b->adjRooms[start + randInt(rng, 0, size)]];
 }
 
-/// @brief adds the rooms to each others room list
-/// @param a is the first room (being added to the second)
-/// @param b is the second room (being added to the first)
-void connectRooms(RoomNode *a, RoomNode *b)
+/// @brief adds evidence to a room, filed under its class and whether it is ghostly so it is only classified once
+/// @param room the room the evidence is left in
+/// @param node the node holding the evidence
+void addRoomEvidence(RoomType *room, EvidenceNode *node)
 {
-  RoomNode *tempA = NULL;
-  RoomNode *tempB = NULL;
-  copyRoom(a->room, &tempA);
-  copyRoom(b->room, &tempB);
-
-  appendRoom(tempA, b->room->rooms);
-  appendRoom(tempB, a->room->rooms);
+  addEvidence(node, &room->evidence[node->evidence->type][isGhostly(node->evidence)]);
+  room->evidenceCount++;
 }
 
-/// @brief finds random room within the given roomlist
-/// @param b is the roomlist where a random room will be selected using a counter and the randInt function
-/// @return returns a roomtype pointer of the randomly selected room
-RoomType *findRandRoom(RoomList *b)
+/// @brief helper for wether or not a room has any evidence left in it
+/// @param room is the room being checked
+/// @return returns true (1) if the room has evidence, otherwise false (0)
+bool hasEvidence(RoomType *room)
 {
-  int size = findSizeOfAdjacentRooms(b);
-  RoomNode *temp = b->head;
-  int a = randInt(0, size);
-  int ctr = 0;
-  while (temp->next != NULL)
-  {
-    if (ctr == a)
-    {
-      break;
-    }
-    ctr++;
-    temp = temp->next;
-  }
-  return temp->room;
+  return room->evidenceCount > 0;
 }
 
-/// @brief collects ghostly evidence from the room of which the hunter is in
+/// @brief collects ghostly evidence from the room of which the hunter is in, taking the oldest ghostly evidence its equipment can read
 /// @param hunter the hunter that is going to be collecting ghostly evidence from it's room
 /// @return returns a boolean signifying whether the new hunter has collected a ghostly evidence or not
 bool collectEvidence(HunterType *hunter)
 {
-
-  EvidenceNode *p = hunter->room->evidence->head;
-  bool hasGhostly = false;
-  while (p != NULL)
+  EvidenceList *ghostly = &hunter->room->evidence[hunter->equipment][1];
+  EvidenceNode *p = ghostly->head;
+  if (p == NULL)
   {
-    if (p->evidence->type == hunter->equipment)
-    {
-      EvidenceNode *node = NULL;
-      if (isGhostly(p->evidence))
-      {
-        hasGhostly = true;
-        copyEvidence(p->evidence, &node);
-        delEvidence(p, hunter->room->evidence);
-        ghostlyIsDifferent(hunter, node->evidence->type);
-
-        addEvidence(node, hunter->evidence);
-        printf("HUNTER: %s HAS COLLECTED %s GHOSTLY EVIDENCE FROM THIS ROOM %s", hunter->name, evidenceEnumToStr(node->evidence->type), hunter->room->name);
-
-        break;
-      }
-    }
-    p = p->next;
+    return false;
   }
 
-  return hasGhostly;
-}
+  EvidenceNode *node = NULL;
+  copyEvidence(hunter->pool, p->evidence, &node);
+  delEvidence(p, ghostly, hunter->pool);
+  hunter->room->evidenceCount--;
+  learnGhostly(hunter, node->evidence->type);
 
-/// @brief finds the size of the given roomlist
-/// @param list the size of which is going to be returned
-/// @return returns an int of the size of the roomList
-int findSizeOfAdjacentRooms(RoomList *list)
-{
-  RoomNode *temp = list->head;
-  int ctr = 0;
-  while (temp != NULL)
-  {
-    ctr++;
-    temp = temp->next;
-  }
-  return ctr;
-}
+  addEvidence(node, hunter->evidence);
+  traceCollect(hunter->building, hunter->id);
+  logEvent(LOG_INFO, "HUNTER: %s HAS COLLECTED %s GHOSTLY EVIDENCE FROM THIS ROOM %s", hunter->name, evidenceEnumToStr(node->evidence->type), hunter->room->name);
 
-/// @brief prints the name of the given roomnode
-/// @param r the roomnode to print
-// needs to be updated for when hunters and ghosts are fully implemented
-void printRoom(RoomNode *r)
-{
-  printf("Room: %s\n", r->room->name);
+  return true;
 }
 
-/// @brief finds the adjacent rooms to the given roomnode and prints them
-/// @param r the roomnode to which the adjacent rooms will be given
-void printRooms(RoomNode *r)
+/// @brief finds the adjacent rooms to the given room and prints them
+/// @param b the building the room is in
+/// @param r the room to which the adjacent rooms will be given
+void printRooms(BuildingType *b, RoomType *r)
 {
-  printf("Printing rooms connected to %s\n", r->room->name);
-  RoomNode *temp = r->room->rooms->head;
-  while (temp != NULL)
+  printf("Printing rooms connected to %s\n", r->name);
+  for (int i = b->adjOffset[r->id]; i < b->adjOffset[r->id + 1]; i++)
   {
-    printRoom(temp);
-    temp = temp->next;
+    printf("Room: %s\n", b->roomIndex[b->adjRooms[i]]->name);
   }
   printf("\n");
-}
\ No newline at end of file
+}
\ No newline at end of file
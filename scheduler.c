@@ -0,0 +1,249 @@
+#include "defs.h"
+
+/// @brief checks whether event a should run before event b, ties on time are broken by the order they were scheduled in
+/// @param a the first event
+/// @param b the second event
+/// @return true if a runs first
+static bool eventBefore(SimEvent *a, SimEvent *b)
+{
+  if (a->time != b->time)
+  {
+    return a->time < b->time;
+  }
+  return a->seq < b->seq;
+}
+
+/// @brief allocates a scheduler with an empty event queue and its clock at 0
+/// @param s double pointer to which the new scheduler will be stored
+void initScheduler(Scheduler **s)
+{
+  *s = calloc(1, sizeof(Scheduler));
+  (*s)->capacity = DEFAULT_HUNTERS + 1;
+  (*s)->heap = calloc((*s)->capacity, sizeof(SimEvent));
+  (*s)->size = 0;
+  (*s)->now = 0;
+  (*s)->seq = 0;
+  (*s)->steps = 0;
+  (*s)->left = NULL;
+  (*s)->checkpoint = NULL;
+}
+
+/// @brief frees the scheduler and its queue, the entities in it are not touched
+/// @param s the scheduler being free'd
+void cleanupScheduler(Scheduler *s)
+{
+  free(s->heap);
+  free(s->left);
+  free(s);
+}
+
+/// @brief queues an entity to wake up at a given virtual time
+/// @param s the scheduler being added to
+/// @param time the virtual time in seconds the entity wakes up at
+/// @param kind whether the entity is a hunter or the ghost
+/// @param entity pointer to the HunterType or GhostType
+void scheduleEvent(Scheduler *s, double time, EntityKind kind, void *entity)
+{
+  if (s->size == s->capacity)
+  {
+    s->capacity *= 2;
+    s->heap = realloc(s->heap, s->capacity * sizeof(SimEvent));
+  }
+
+  // sift the new event up from the bottom of the heap
+  SimEvent e = {time, s->seq++, kind, entity};
+  int i = s->size++;
+  while (i > 0)
+  {
+    int parent = (i - 1) / 2;
+    if (!eventBefore(&e, &s->heap[parent]))
+    {
+      break;
+    }
+    s->heap[i] = s->heap[parent];
+    i = parent;
+  }
+  s->heap[i] = e;
+}
+
+/// @brief removes the earliest event from the queue
+/// @param s the scheduler being popped from
+/// @param out where the earliest event is stored
+/// @return false if the queue was empty
+bool popEvent(Scheduler *s, SimEvent *out)
+{
+  if (s->size == 0)
+  {
+    return false;
+  }
+  *out = s->heap[0];
+
+  // sift the last event down from the top of the heap
+  SimEvent last = s->heap[--s->size];
+  int i = 0;
+  while (true)
+  {
+    int child = 2 * i + 1;
+    if (child >= s->size)
+    {
+      break;
+    }
+    if (child + 1 < s->size && eventBefore(&s->heap[child + 1], &s->heap[child]))
+    {
+      child++;
+    }
+    if (!eventBefore(&s->heap[child], &last))
+    {
+      break;
+    }
+    s->heap[i] = s->heap[child];
+    i = child;
+  }
+  s->heap[i] = last;
+  return true;
+}
+
+/// @brief queues every hunter and ghost of a building to wake up at the current time
+/// @param s the scheduler being added to
+/// @param b the building whose entities are added
+void scheduleBuilding(Scheduler *s, BuildingType *b)
+{
+  for (int i = 0; i < b->noteBook->count; i++)
+  {
+    scheduleEvent(s, s->now, HUNTER_ENTITY, b->noteBook->hunters[i]);
+  }
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    scheduleEvent(s, s->now, GHOST_ENTITY, b->ghosts[i]);
+  }
+}
+
+/// @brief steps a hunter or ghost once and, if it is still in the hunt, draws how long it sleeps before its next step
+/// @param kind whether the entity is a hunter or a ghost
+/// @param entity pointer to the HunterType or GhostType
+/// @param delay where the number of seconds until its next step is stored
+/// @return true if the entity is still in the hunt, false once it has left
+bool stepEntity(EntityKind kind, void *entity, double *delay)
+{
+  uint64_t started = metricStart();
+  bool active;
+  RoomType *room;
+  if (kind == HUNTER_ENTITY)
+  {
+    HunterType *h = (HunterType *)entity;
+    active = stepHunter(h);
+    room = h->room;
+    if (active)
+    {
+      *delay = randFloat(&h->rng, h->building->config.hunterSleepMin, h->building->config.hunterSleepMax);
+    }
+  }
+  else
+  {
+    GhostType *g = (GhostType *)entity;
+    active = stepGhost(g);
+    room = g->room;
+    if (active)
+    {
+      *delay = randFloat(&g->rng, g->building->config.ghostSleepMin, g->building->config.ghostSleepMax);
+    }
+  }
+  metricStep(started, room, active, active ? *delay : 0);
+  return active;
+}
+
+/// @brief runs the queue until every entity has left, jumping the clock straight to each wake up instead of sleeping
+/// @param s the scheduler being run
+void runScheduler(Scheduler *s)
+{
+  SimEvent e;
+  double delay;
+  while (popEvent(s, &e))
+  {
+    s->now = e.time;
+    s->steps++;
+    if (stepEntity(e.kind, e.entity, &delay))
+    {
+      scheduleEvent(s, s->now + delay, e.kind, e.entity);
+    }
+    // between steps every entity still in the hunt is in the queue, so the hunt can be picked up from here
+    if (s->checkpoint != NULL)
+    {
+      checkpointHunt(s);
+    }
+  }
+}
+
+/// @brief runs a hunt in lock step instead of by wake up, every hunter and ghost still in the hunt steps once per tick,
+/// the checks of every hunter are made together over the entity table so they vectorize, then each hunter acts in turn and then each ghost
+/// @param s the scheduler, only its clock, step count and left are used, left is kept from a resumed hunt
+/// @param b the building, every entity must already be in it
+void runTicks(Scheduler *s, BuildingType *b)
+{
+  EntityTable *t = &b->table;
+  int hunters = b->noteBook->count;
+  if (s->left == NULL)
+  {
+    s->left = calloc(hunters + b->ghostCount, sizeof(bool));
+  }
+  bool *left = s->left;
+  int active = 0;
+  for (int i = 0; i < hunters + b->ghostCount; i++)
+  {
+    active += !left[i];
+  }
+  while (active > 0)
+  {
+    // hunters that have left read no ghosts, so checkHunters leaves their fear and boredom alone
+    for (int i = 0; i < hunters; i++)
+    {
+      t->ghostsHere[i] = left[i] ? 0 : atomic_load_explicit(&t->room[i]->ghosts, memory_order_relaxed);
+      t->found[i] = knownKinds(b, i);
+    }
+    checkHunters(t, &b->config, 0, hunters);
+
+    for (int i = 0; i < hunters; i++)
+    {
+      if (left[i])
+      {
+        continue;
+      }
+      uint64_t started = metricStart();
+      HunterType *h = b->noteBook->hunters[i];
+      bool stays = applyCheck(h);
+      if (stays)
+      {
+        actHunter(h);
+      }
+      else
+      {
+        left[i] = true;
+        active--;
+      }
+      metricStep(started, h->room, stays, TICK_LENGTH);
+      s->steps++;
+    }
+    for (int i = 0; i < b->ghostCount; i++)
+    {
+      if (left[hunters + i])
+      {
+        continue;
+      }
+      uint64_t started = metricStart();
+      GhostType *g = b->ghosts[i];
+      bool stays = stepGhost(g);
+      if (!stays)
+      {
+        left[hunters + i] = true;
+        active--;
+      }
+      metricStep(started, g->room, stays, TICK_LENGTH);
+      s->steps++;
+    }
+    s->now += TICK_LENGTH;
+    if (s->checkpoint != NULL)
+    {
+      checkpointHunt(s);
+    }
+  }
+}
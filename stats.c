@@ -0,0 +1,123 @@
+#include "defs.h"
+
+/*
+    Streaming statistics that need no record of the values they were
+    fed, so a batch of millions of hunts is summed up in fixed memory
+    and every worker can keep its own and merge them later.
+
+    A RunningStat keeps the count, mean and sum of squared differences
+    from the mean by Welford's method, which stays accurate where
+    summing squares would cancel, and two are merged exactly by Chan's
+    formula.
+
+    A QuantileSketch is a histogram over buckets that grow with the
+    value: values below SKETCH_SUB each get a bucket of their own, and
+    above that every power of two is split into SKETCH_SUB buckets, so
+    a quantile comes out within 1 / SKETCH_SUB of the true value
+    whatever the spread. Merging adds the buckets, so a merged sketch
+    is exactly the sketch of every value fed to either.
+*/
+
+/// @brief adds a value to a running statistic
+/// @param s the statistic
+/// @param x the value
+void addRunningStat(RunningStat *s, double x)
+{
+  s->count++;
+  double delta = x - s->mean;
+  s->mean += delta / s->count;
+  s->m2 += delta * (x - s->mean);
+}
+
+/// @brief adds one running statistic into another, as if every value of both had been added to it
+/// @param from the statistic being merged
+/// @param into the statistic being merged into
+void mergeRunningStat(RunningStat *from, RunningStat *into)
+{
+  if (from->count == 0)
+  {
+    return;
+  }
+  long count = into->count + from->count;
+  double delta = from->mean - into->mean;
+  into->mean += delta * from->count / count;
+  into->m2 += from->m2 + delta * delta * ((double)into->count * from->count / count);
+  into->count = count;
+}
+
+/// @brief the standard deviation of the values added to a running statistic
+/// @param s the statistic
+/// @return the sample standard deviation, 0 for fewer than two values
+double runningStdDev(RunningStat *s)
+{
+  return s->count > 1 ? sqrt(s->m2 / (s->count - 1)) : 0;
+}
+
+/// @brief the bucket of a sketch a value falls in
+/// @param v the value
+/// @return the bucket, values too large for the sketch all fall in the last
+static int sketchBucket(uint64_t v)
+{
+  if (v < SKETCH_SUB)
+  {
+    return (int)v;
+  }
+  // the power of two picks the group of buckets and the bits below the top one pick the bucket in it
+  int power = 63 - __builtin_clzll(v);
+  int bucket = (power - SKETCH_SUB_BITS + 1) * SKETCH_SUB + (int)((v >> (power - SKETCH_SUB_BITS)) & (SKETCH_SUB - 1));
+  return bucket < SKETCH_BUCKETS ? bucket : SKETCH_BUCKETS - 1;
+}
+
+/// @brief the smallest value that falls in a bucket of a sketch
+/// @param bucket the bucket
+/// @return the value
+static double sketchLow(int bucket)
+{
+  if (bucket < SKETCH_SUB)
+  {
+    return bucket;
+  }
+  int power = bucket / SKETCH_SUB + SKETCH_SUB_BITS - 1;
+  return ldexp(SKETCH_SUB + bucket % SKETCH_SUB, power - SKETCH_SUB_BITS);
+}
+
+/// @brief adds a value to a quantile sketch
+/// @param s the sketch
+/// @param v the value, rounded down to a whole number, negative values count as 0
+void addSketch(QuantileSketch *s, double v)
+{
+  s->count++;
+  s->buckets[sketchBucket(v > 0 ? (uint64_t)v : 0)]++;
+}
+
+/// @brief adds one quantile sketch into another
+/// @param from the sketch being merged
+/// @param into the sketch being merged into
+void mergeSketch(QuantileSketch *from, QuantileSketch *into)
+{
+  into->count += from->count;
+  for (int i = 0; i < SKETCH_BUCKETS; i++)
+  {
+    into->buckets[i] += from->buckets[i];
+  }
+}
+
+/// @brief estimates a quantile of the values added to a sketch
+/// @param s the sketch
+/// @param q the quantile, between 0 and 1
+/// @return the middle of the whole numbers in the bucket the quantile falls in, exact below SKETCH_SUB, 0 for an empty sketch
+double sketchQuantile(QuantileSketch *s, double q)
+{
+  long rank = (long)ceil(q * s->count);
+  rank = rank < 1 ? 1 : rank;
+  long seen = 0;
+  for (int i = 0; i < SKETCH_BUCKETS; i++)
+  {
+    seen += s->buckets[i];
+    if (seen >= rank)
+    {
+      return (sketchLow(i) + sketchLow(i + 1) - 1) / 2;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,345 @@
+#include "defs.h"
+
+/*
+    Parameter sweeps, run with -S FILE. A sweep file names the config
+    parameters to vary, one per line, and leaves the rest at the config
+    given with -c and -P:
+
+        # a list of values
+        fear_rate = 1, 2, 4
+        max_fear = 50, 100, 200
+        # a range, only when sampling
+        hunter_sleep_max = 0.5 : 2
+
+    Without -R every combination of the lists is run, a grid of 9
+    configurations here. -R N draws N configurations instead, every
+    parameter picked uniformly from its list or range.
+
+    Every configuration runs the same -b hunts, seeds SEED to
+    SEED + runs - 1, so rows differ by their parameters rather than
+    by luck. Workers claim hunts one at a time from a single counter,
+    configuration by configuration, so all of them help finish the
+    configurations in front before moving on. The worker that finishes
+    the last hunt of a configuration writes its CSV row straight away,
+    which makes rows arrive in about the order of their config number
+    while the sweep is still running.
+*/
+
+// the hunts of one configuration of a running sweep
+typedef struct SweepPoint
+{
+  BatchStats stats;
+  pthread_mutex_t mutex;
+  atomic_long remaining; // hunts still to finish, the worker that takes it to 0 writes the row
+} SweepPoint;
+
+// shared by every worker of a sweep
+typedef struct SweepRun
+{
+  Sweep *sweep;
+  SweepPoint *points;
+  SimOptions *opts;
+  long runs;
+  uint64_t seed;
+  atomic_long next; // next hunt to claim, hunt i of configuration c is c * runs + i
+  FILE *out;
+  pthread_mutex_t outMutex;
+} SweepRun;
+
+/// @brief appends a value to an axis, doubling its values when they are full
+/// @param a the axis
+/// @param v the value
+static void addAxisValue(SweepAxis *a, double v)
+{
+  if (a->count == a->capacity)
+  {
+    a->capacity = a->capacity == 0 ? 8 : a->capacity * 2;
+    a->values = realloc(a->values, a->capacity * sizeof(double));
+  }
+  a->values[a->count++] = v;
+}
+
+/// @brief reads the values of an axis, either a comma separated list or two bounds separated by a colon
+/// @param a the axis, its key already set
+/// @param text the values
+/// @return 0 on success, otherwise -1 if a value is not a number
+static int parseAxis(SweepAxis *a, char *text)
+{
+  a->range = strchr(text, ':') != NULL;
+  char *p = text;
+  while (true)
+  {
+    char *after;
+    double v = strtod(p, &after);
+    if (after == p)
+    {
+      return -1;
+    }
+    addAxisValue(a, v);
+    while (*after == ' ' || *after == '\t')
+    {
+      after++;
+    }
+    if (*after == '\0')
+    {
+      break;
+    }
+    if (*after != (a->range ? ':' : ','))
+    {
+      return -1;
+    }
+    p = after + 1;
+  }
+  if (a->range && (a->count != 2 || a->values[1] < a->values[0]))
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/// @brief reads a sweep file
+/// @param path the path of the sweep file
+/// @param sweep double pointer to which the new sweep will be stored, it has no configurations until expandSweep
+/// @return 0 on success, otherwise -1 if the file could not be read, a line is malformed or names an unknown or repeated parameter
+int loadSweep(const char *path, Sweep **sweep)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+  {
+    return -1;
+  }
+  Sweep *s = calloc(1, sizeof(Sweep));
+  int capacity = 0;
+  char line[CONFIG_LINE];
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    char *key, *values;
+    char *p = line + strspn(line, " \t\r\n");
+    if (*p == '\0' || *p == '#')
+    {
+      continue;
+    }
+    if (splitConfigLine(p, &key, &values) != 0 || findConfigKey(key) == NULL)
+    {
+      goto fail;
+    }
+    for (int i = 0; i < s->axisCount; i++)
+    {
+      if (s->axes[i].key == findConfigKey(key))
+      {
+        goto fail;
+      }
+    }
+    if (s->axisCount == capacity)
+    {
+      capacity = capacity == 0 ? 4 : capacity * 2;
+      s->axes = realloc(s->axes, capacity * sizeof(SweepAxis));
+      memset(s->axes + s->axisCount, 0, (capacity - s->axisCount) * sizeof(SweepAxis));
+    }
+    SweepAxis *a = &s->axes[s->axisCount++];
+    a->key = findConfigKey(key);
+    if (parseAxis(a, values) != 0)
+    {
+      goto fail;
+    }
+  }
+  fclose(f);
+  if (s->axisCount == 0)
+  {
+    cleanupSweep(s);
+    return -1;
+  }
+  *sweep = s;
+  return 0;
+
+fail:
+  fclose(f);
+  cleanupSweep(s);
+  return -1;
+}
+
+/// @brief works out every configuration a sweep runs, all of its lists combined, or a sample of them when samples is above 0
+/// @param s the sweep, any configurations it already had are replaced
+/// @param base the parameters the sweep does not vary
+/// @param samples how many configurations to draw, 0 runs the whole grid
+/// @param seed seeds the draws
+/// @return 0 on success, otherwise -1 if the grid has a range or more than SWEEP_MAX_CONFIGS configurations
+int expandSweep(Sweep *s, SimConfig *base, long samples, uint64_t seed)
+{
+  long count = samples;
+  if (samples <= 0)
+  {
+    count = 1;
+    for (int i = 0; i < s->axisCount; i++)
+    {
+      if (s->axes[i].range)
+      {
+        return -1;
+      }
+      count *= s->axes[i].count;
+      if (count > SWEEP_MAX_CONFIGS)
+      {
+        return -1;
+      }
+    }
+  }
+
+  free(s->configs);
+  s->configs = malloc(count * sizeof(SimConfig));
+  s->configCount = count;
+  RandState rng;
+  seedRand(&rng, seed);
+  for (long c = 0; c < count; c++)
+  {
+    SimConfig *config = &s->configs[c];
+    *config = *base;
+    // the grid is counted through like a number whose last axis is the lowest digit
+    long rest = c;
+    for (int i = s->axisCount - 1; i >= 0; i--)
+    {
+      SweepAxis *a = &s->axes[i];
+      double v;
+      if (samples <= 0)
+      {
+        v = a->values[rest % a->count];
+        rest /= a->count;
+      }
+      else if (a->range)
+      {
+        v = a->values[0] + (a->values[1] - a->values[0]) * ((nextRand(&rng) >> 11) * 0x1.0p-53);
+      }
+      else
+      {
+        v = a->values[randInt(&rng, 0, a->count)];
+      }
+      setConfigValue(config, a->key, v);
+    }
+  }
+  return 0;
+}
+
+/// @brief writes the result of one configuration as a CSV row
+/// @param run the sweep being run
+/// @param c the configuration
+static void writeSweepRow(SweepRun *run, long c)
+{
+  Sweep *s = run->sweep;
+  BatchStats *st = &run->points[c].stats;
+  double runs = st->runs > 0 ? (double)st->runs : 1.0;
+  pthread_mutex_lock(&run->outMutex);
+  fprintf(run->out, "%ld", c);
+  for (int i = 0; i < s->axisCount; i++)
+  {
+    fprintf(run->out, ",%g", getConfigValue(&s->configs[c], s->axes[i].key));
+  }
+  fprintf(run->out, ",%ld,%.4f,%.4f,%.4f,%.2f,%.2f\n", st->runs, st->outcomes[HUNTERS_WIN] / runs, st->outcomes[GHOST_WIN] / runs,
+          st->outcomes[ALL_BORED] / runs, st->totalSteps / runs, st->totalSimTime / runs);
+  fflush(run->out);
+  pthread_mutex_unlock(&run->outMutex);
+}
+
+/// @brief worker thread for a sweep, claims hunts from the shared counter until none are left
+/// @param arg void pointer, will be typecasted to the SweepRun
+static void *sweepWorker(void *arg)
+{
+  SweepRun *run = (SweepRun *)arg;
+  SimResult r;
+  initSimResult(&r);
+  long total = run->sweep->configCount * run->runs;
+  long job;
+  while ((job = atomic_fetch_add(&run->next, 1)) < total)
+  {
+    long c = job / run->runs;
+    SimOptions opts = *run->opts;
+    opts.config = &run->sweep->configs[c];
+    runSimulation(run->seed + job % run->runs, &opts, &r);
+
+    SweepPoint *p = &run->points[c];
+    pthread_mutex_lock(&p->mutex);
+    addSimResult(&r, &p->stats);
+    pthread_mutex_unlock(&p->mutex);
+    if (atomic_fetch_sub(&p->remaining, 1) == 1)
+    {
+      writeSweepRow(run, c);
+    }
+  }
+  cleanupSimResult(&r);
+  return NULL;
+}
+
+/// @brief runs every configuration of a sweep across worker threads, writing a CSV header and then a row per configuration as each finishes
+/// @param s the sweep, already expanded
+/// @param runs the number of hunts per configuration
+/// @param threads the number of worker threads, 0 uses one per online core
+/// @param seed seed of the first hunt of every configuration, hunt i uses seed + i
+/// @param opts how every hunt is set up, its config is replaced by each configuration in turn and nothing is recorded
+/// @param out where the rows are written
+void runSweep(Sweep *s, long runs, int threads, uint64_t seed, SimOptions *opts, FILE *out)
+{
+  if (threads <= 0)
+  {
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+    {
+      threads = 1;
+    }
+  }
+
+  SimOptions shared = *opts;
+  shared.traceDir = NULL;
+  SweepRun run;
+  run.sweep = s;
+  run.points = calloc(s->configCount, sizeof(SweepPoint));
+  run.opts = &shared;
+  run.runs = runs;
+  run.seed = seed;
+  run.out = out;
+  atomic_init(&run.next, 0);
+  pthread_mutex_init(&run.outMutex, NULL);
+  for (long c = 0; c < s->configCount; c++)
+  {
+    initBatchStats(&run.points[c].stats, false);
+    pthread_mutex_init(&run.points[c].mutex, NULL);
+    atomic_init(&run.points[c].remaining, runs);
+  }
+
+  fprintf(out, "config");
+  for (int i = 0; i < s->axisCount; i++)
+  {
+    fprintf(out, ",%s", s->axes[i].key->name);
+  }
+  fprintf(out, ",runs,hunter_win_rate,ghost_win_rate,bored_rate,mean_steps,mean_sim_seconds\n");
+  fflush(out);
+
+  pthread_t *ids = calloc(threads, sizeof(pthread_t));
+  for (int i = 0; i < threads; i++)
+  {
+    pthread_create(ids + i, NULL, sweepWorker, &run);
+  }
+  for (int i = 0; i < threads; i++)
+  {
+    pthread_join(ids[i], NULL);
+  }
+
+  for (long c = 0; c < s->configCount; c++)
+  {
+    pthread_mutex_destroy(&run.points[c].mutex);
+    cleanupBatchStats(&run.points[c].stats);
+  }
+  pthread_mutex_destroy(&run.outMutex);
+  free(run.points);
+  free(ids);
+}
+
+/// @brief frees a sweep, its axes and its configurations
+/// @param s the sweep
+void cleanupSweep(Sweep *s)
+{
+  for (int i = 0; i < s->axisCount; i++)
+  {
+    free(s->axes[i].values);
+  }
+  free(s->axes);
+  free(s->configs);
+  free(s);
+}
@@ -0,0 +1,342 @@
+#include "defs.h"
+
+/*
+    Binary event traces. A trace file is a header describing the hunt
+    followed by chunks of events:
+
+        header  "GHTR", u8 version, u64 seed,
+                varint roomCount, roomCount x (u8 length, name),
+                varint edgeCount, edgeCount x (varint room, varint room),
+                varint spawn,
+                varint hunterCount, hunterCount x (u8 length, name, u8 equipment),
+                varint ghostCount, ghostCount x (u8 type, varint room)
+        chunk   u32 length, varint writer, varint baseTime, events
+
+    Each event is a u8 TraceOp, a varint of microseconds since the
+    previous event in the chunk (the first is relative to baseTime), a
+    varint entity and the payload listed next to TraceOp in defs.h.
+    Hunters are entities 0 to hunterCount - 1 and ghosts follow them.
+    Every ghost is in its starting room from the beginning of the hunt
+    (version 1 traces only counted it there once it first moved).
+
+    Every thread that records into a trace gets its own buffer, which is
+    only written to the file (under the trace lock) when it fills up or
+    the trace is closed. Chunks from one writer are in order; chunks from
+    different writers are merged by time when the trace is read.
+*/
+
+static atomic_long nextTraceId = 1;
+
+// the buffer the calling thread records into, only valid while traceId matches the trace
+static _Thread_local TraceBuffer *myBuffer = NULL;
+static _Thread_local long myTraceId = 0;
+
+/// @brief appends an unsigned LEB128 varint to a byte buffer
+/// @param p where the varint is written
+/// @param v the value
+/// @return the number of bytes written, at most 10
+static int putVarint(unsigned char *p, uint64_t v)
+{
+  int n = 0;
+  while (v >= 0x80)
+  {
+    p[n++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (unsigned char)v;
+  return n;
+}
+
+/// @brief writes a varint straight to a file, used for the header
+/// @param f the file
+/// @param v the value
+static void writeVarint(FILE *f, uint64_t v)
+{
+  unsigned char buf[10];
+  fwrite(buf, 1, putVarint(buf, v), f);
+}
+
+/// @brief writes a short length prefixed string to a file
+/// @param f the file
+/// @param s the string, at most 255 bytes are kept
+static void writeName(FILE *f, const char *s)
+{
+  size_t len = strlen(s);
+  unsigned char n = len > 255 ? 255 : (unsigned char)len;
+  fputc(n, f);
+  fwrite(s, 1, n, f);
+}
+
+/// @brief the current time of a trace in microseconds, virtual if it runs on a scheduler, otherwise since the trace started
+/// @param t the trace
+/// @return microseconds
+static uint64_t traceTime(Trace *t)
+{
+  if (t->clock != NULL)
+  {
+    return (uint64_t)(*t->clock * 1e6);
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - t->start.tv_sec) * 1000000 + (now.tv_nsec - t->start.tv_nsec) / 1000;
+}
+
+/// @brief writes a buffer out as one chunk and empties it, the caller must hold the trace lock
+/// @param t the trace
+/// @param b the buffer being written
+static void writeChunk(Trace *t, TraceBuffer *b)
+{
+  if (b->used == 0)
+  {
+    return;
+  }
+  uint32_t length = (uint32_t)b->used;
+  fwrite(&length, sizeof(length), 1, t->file);
+  writeVarint(t->file, b->writer);
+  writeVarint(t->file, b->baseTime);
+  fwrite(b->data, 1, b->used, t->file);
+  b->used = 0;
+}
+
+/// @brief opens a trace file and records the seed, layout and starting state of a building into it, from then on the hunt is recorded
+/// @param b the building, its hunters and ghost must already be created
+/// @param path the file the trace is written to
+/// @param clock the virtual clock the hunt runs on, or NULL to time events by the wall clock
+/// @return 0 on success, otherwise -1 if the file could not be opened
+int startTrace(BuildingType *b, const char *path, double *clock)
+{
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+  {
+    return -1;
+  }
+
+  Trace *t = calloc(1, sizeof(Trace));
+  t->file = f;
+  t->id = atomic_fetch_add(&nextTraceId, 1);
+  pthread_mutex_init(&t->mutex, NULL);
+  t->buffers = NULL;
+  t->writers = 0;
+  t->clock = clock;
+  clock_gettime(CLOCK_MONOTONIC, &t->start);
+
+  fwrite(TRACE_MAGIC, 1, 4, f);
+  fputc(TRACE_VERSION, f);
+  fwrite(&b->seed, sizeof(b->seed), 1, f);
+
+  writeVarint(f, b->roomCount);
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    writeName(f, b->roomIndex[i]->name);
+  }
+  // every connection is stored once, from the lower numbered room
+  long edges = 0;
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    for (int j = b->adjOffset[i]; j < b->adjOffset[i + 1]; j++)
+    {
+      edges += b->adjRooms[j] > i;
+    }
+  }
+  writeVarint(f, edges);
+  for (int i = 0; i < b->roomCount; i++)
+  {
+    for (int j = b->adjOffset[i]; j < b->adjOffset[i + 1]; j++)
+    {
+      if (b->adjRooms[j] > i)
+      {
+        writeVarint(f, i);
+        writeVarint(f, b->adjRooms[j]);
+      }
+    }
+  }
+  writeVarint(f, b->spawn->id);
+
+  writeVarint(f, b->noteBook->count);
+  for (int i = 0; i < b->noteBook->count; i++)
+  {
+    writeName(f, b->noteBook->hunters[i]->name);
+    fputc(b->noteBook->hunters[i]->equipment, f);
+  }
+  writeVarint(f, b->ghostCount);
+  for (int i = 0; i < b->ghostCount; i++)
+  {
+    fputc(b->ghosts[i]->type, f);
+    writeVarint(f, b->ghosts[i]->room->id);
+  }
+
+  b->trace = t;
+  return 0;
+}
+
+/// @brief writes out every buffer still holding events, closes the file and frees the trace, only call once the hunt is over
+/// @param b the building being traced
+void stopTrace(BuildingType *b)
+{
+  Trace *t = b->trace;
+  if (t == NULL)
+  {
+    return;
+  }
+  b->trace = NULL;
+
+  pthread_mutex_lock(&t->mutex);
+  TraceBuffer *temp;
+  while (t->buffers != NULL)
+  {
+    temp = t->buffers;
+    t->buffers = t->buffers->next;
+    writeChunk(t, temp);
+    free(temp);
+  }
+  pthread_mutex_unlock(&t->mutex);
+
+  pthread_mutex_destroy(&t->mutex);
+  fclose(t->file);
+  free(t);
+}
+
+/// @brief starts an event in the calling threads buffer, writing the buffer out first if the event might not fit
+/// @param t the trace
+/// @param op the kind of event
+/// @param entity the entity the event is about
+/// @return the buffer, with the op, time and entity already written
+static TraceBuffer *beginEvent(Trace *t, TraceOp op, int entity)
+{
+  if (myTraceId != t->id)
+  {
+    // no need to zero the 64k of event data
+    myBuffer = malloc(sizeof(TraceBuffer));
+    myBuffer->used = 0;
+    myTraceId = t->id;
+    pthread_mutex_lock(&t->mutex);
+    myBuffer->writer = t->writers++;
+    myBuffer->next = t->buffers;
+    t->buffers = myBuffer;
+    pthread_mutex_unlock(&t->mutex);
+  }
+
+  TraceBuffer *b = myBuffer;
+  uint64_t now = traceTime(t);
+  if (b->used > TRACE_BUFFER_SIZE - TRACE_MAX_EVENT)
+  {
+    pthread_mutex_lock(&t->mutex);
+    writeChunk(t, b);
+    pthread_mutex_unlock(&t->mutex);
+  }
+  if (b->used == 0)
+  {
+    b->baseTime = now;
+    b->lastTime = now;
+  }
+  // a wall clock read on another core can be a hair behind the last one, never go backwards
+  if (now < b->lastTime)
+  {
+    now = b->lastTime;
+  }
+
+  b->data[b->used++] = (unsigned char)op;
+  b->used += putVarint(b->data + b->used, now - b->lastTime);
+  b->used += putVarint(b->data + b->used, entity);
+  b->lastTime = now;
+  return b;
+}
+
+/// @brief records an entity moving into a room
+/// @param b the building
+/// @param entity the hunter or ghost id
+/// @param room the room moved into
+void traceMove(BuildingType *b, int entity, RoomType *room)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  TraceBuffer *tb = beginEvent(b->trace, TRACE_MOVE, entity);
+  tb->used += putVarint(tb->data + tb->used, room->id);
+}
+
+/// @brief records a ghost leaving evidence in its room
+/// @param b the building
+/// @param entity the ghost id
+/// @param e the evidence left behind
+void traceDrop(BuildingType *b, int entity, EvidenceType *e)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  TraceBuffer *tb = beginEvent(b->trace, TRACE_DROP, entity);
+  tb->data[tb->used++] = (unsigned char)e->type;
+  memcpy(tb->data + tb->used, &e->value, sizeof(float));
+  tb->used += sizeof(float);
+}
+
+/// @brief records a hunter taking a standard reading with its equipment
+/// @param b the building
+/// @param entity the hunter id
+/// @param e the reading
+void traceStandard(BuildingType *b, int entity, EvidenceType *e)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  TraceBuffer *tb = beginEvent(b->trace, TRACE_STANDARD, entity);
+  memcpy(tb->data + tb->used, &e->value, sizeof(float));
+  tb->used += sizeof(float);
+}
+
+/// @brief records a hunter collecting the oldest ghostly evidence its equipment reads from its room
+/// @param b the building
+/// @param entity the hunter id
+void traceCollect(BuildingType *b, int entity)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  beginEvent(b->trace, TRACE_COLLECT, entity);
+}
+
+/// @brief records a hunter sharing its first ghostly evidence with another
+/// @param b the building
+/// @param entity the hunter sharing
+/// @param to the hunter shared with
+void traceShare(BuildingType *b, int entity, int to)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  TraceBuffer *tb = beginEvent(b->trace, TRACE_SHARE, entity);
+  tb->used += putVarint(tb->data + tb->used, to);
+}
+
+/// @brief records the new fear of a hunter
+/// @param b the building
+/// @param entity the hunter id
+/// @param fear the fear it now has
+void traceFear(BuildingType *b, int entity, int fear)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  TraceBuffer *tb = beginEvent(b->trace, TRACE_FEAR, entity);
+  tb->used += putVarint(tb->data + tb->used, fear);
+}
+
+/// @brief records an entity leaving the hunt
+/// @param b the building
+/// @param entity the hunter or ghost id
+/// @param reason why it left
+void traceExit(BuildingType *b, int entity, ExitReason reason)
+{
+  if (b->trace == NULL)
+  {
+    return;
+  }
+  TraceBuffer *tb = beginEvent(b->trace, TRACE_EXIT, entity);
+  tb->data[tb->used++] = (unsigned char)reason;
+}